@@ -32,6 +32,8 @@ parser.add_argument('device',
         help='Smoothie Serial Device')
 parser.add_argument('-q','--quiet',action='store_true', default=False,
         help='suppress output text')
+parser.add_argument('-c','--char-count',type=int, default=0, metavar='N',
+        help='character counting, keep at most N unacknowledged chars in flight, N must not exceed the free space ? reports in Bf:')
 args = parser.parse_args()
 
 f = args.gcode_file
@@ -48,6 +50,8 @@ s.flushInput()  # Flush startup text in serial input
 print("Streaming " + args.gcode_file.name + " to " + args.device)
 
 okcnt= 0
+inflight= []  # lengths of the lines not acknowledged yet when character counting
+inflight_lock= threading.Condition()
 
 def read_thread():
     """thread worker function"""
@@ -63,6 +67,10 @@ def read_thread():
                 break
         else :
             okcnt += n
+            if args.char_count > 0 :
+                with inflight_lock:
+                    del inflight[:n]
+                    inflight_lock.notify()
 
     print("Read thread exited")
     return
@@ -81,6 +89,12 @@ try:
         if line.startswith(';') :
             continue
         l= line.strip()
+        if args.char_count > 0 :
+            # wait until the firmware has room for this line
+            with inflight_lock:
+                while sum(inflight) + len(l) + 1 > args.char_count and not errorflg :
+                    inflight_lock.wait(1)
+                inflight.append(len(l) + 1)
         s.write(l + '\n')
         linecnt+=1
         if verbose: print("SND " + str(linecnt) + ": " + line.strip() + " - " + str(okcnt))
@@ -1,12 +1,61 @@
 #include "AppendFileStream.h"
+#include "us_ticker_api.h"
 #include <stdio.h>
 
+AppendFileStream::AppendFileStream(const char *filename, size_t buffer_size)
+{
+    fn = strdup(filename);
+    // without a buffer every write goes straight to the file as it always did
+    buf = static_cast<char *>(malloc(buffer_size));
+    size = buf != nullptr ? buffer_size : 0;
+    used = 0;
+    written = 0;
+    first_us = 0;
+}
+
+AppendFileStream::~AppendFileStream()
+{
+    flush();
+    free(buf);
+    free(fn);
+}
+
 int AppendFileStream::puts(const char *str, int size)
 {
-    FILE *fd= fopen(this->fn, "a");
+    size_t n = size > 0 ? size : strlen(str);
+    if(n == 0) return 0;
+
+    if(used + n > this->size) {
+        flush();
+        // too big to ever fit, write it out behind what was buffered
+        if(n > this->size) return append(str, n);
+    }
+    if(used == 0) first_us = us_ticker_read();
+    memcpy(buf + used, str, n);
+    used += n;
+    return n;
+}
+
+void AppendFileStream::flush()
+{
+    if(used == 0) return;
+    append(buf, used);
+    // what could not be written is dropped so a missing card does not stall the caller forever
+    used = 0;
+}
+
+void AppendFileStream::flush_if_due(uint32_t max_age_ms)
+{
+    if(used > 0 && us_ticker_read() - first_us >= max_age_ms * 1000) flush();
+}
+
+int AppendFileStream::append(const char *str, size_t n)
+{
+    FILE *fd = fopen(this->fn, "a");
     if(fd == NULL) return 0;
 
-    int n= fwrite(str, 1, strlen(str), fd);
+    int w = fwrite(str, 1, n, fd);
     fclose(fd);
-    return n;
+    written += w;
+    return w;
 }
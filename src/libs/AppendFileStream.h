@@ -4,15 +4,33 @@
 #include "StreamOutput.h"
 #include "string.h"
 #include "stdlib.h"
+#include "stdint.h"
 
+// Appends everything written to a file, batched in RAM so the file is opened once per buffer full instead of once per write
+// Buffered data is written when the buffer fills, on flush(), when the stream is deleted, or by flush_if_due() once it is old enough
 class AppendFileStream : public StreamOutput {
     public:
-        AppendFileStream(const char *filename) { fn= strdup(filename); }
-        virtual ~AppendFileStream(){ free(fn); }
+        AppendFileStream(const char *filename, size_t buffer_size = 512);
+        virtual ~AppendFileStream();
         int puts(const char*, int size = 0);
+        void flush();
+        // call from the main loop, writes out data that has been waiting longer than max_age_ms
+        void flush_if_due(uint32_t max_age_ms);
+
+        size_t pending() const { return used; }
+        // bytes that reached the file since the stream was created
+        uint32_t get_written() const { return written; }
+        const char *get_filename() const { return fn; }
 
     private:
+        int append(const char *str, size_t n);
+
         char *fn;
+        char *buf;
+        size_t size;
+        size_t used;
+        uint32_t written;
+        uint32_t first_us;      // when the oldest pending byte was buffered
 };
 
 #endif
@@ -84,6 +84,18 @@ off_t FATFileHandle::lseek(off_t position, int whence) {
     }
 }
         
+bool FATFileHandle::fast_seek(DWORD *tbl, uint32_t entries) {
+    _fh.cltbl = tbl;
+    tbl[0] = entries;
+    FRESULT res = f_lseek(&_fh, CREATE_LINKMAP);
+    if(res) {
+        FFSDEBUG("fast seek not available (%d, %s), table needs %lu entries\n", res, FR_ERRORS[res], tbl[0]);
+        _fh.cltbl = 0;
+        return false;
+    }
+    return true;
+}
+
 int FATFileHandle::fsync() {
     FFSDEBUG("fsync()\n");
     FRESULT res = f_sync(&_fh);
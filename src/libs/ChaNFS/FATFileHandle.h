@@ -22,6 +22,10 @@ public:
     virtual int fsync();
     virtual off_t flen();
 
+    // builds a cluster link map in tbl (entries DWORDs) so seeks and reads no longer follow the FAT chain,
+    // falls back to normal seeking if the file is too fragmented for the table
+    bool fast_seek(DWORD *tbl, uint32_t entries);
+
 protected:
 
     FIL_t _fh;
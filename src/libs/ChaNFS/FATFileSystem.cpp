@@ -54,6 +54,8 @@ static const char *FR_ERRORS[] = {
 #endif
 
 FATFileSystem *FATFileSystem::_ffs[_DRIVES] = {0};
+DWORD *FATFileSystem::_fast_seek_tbl = NULL;
+uint32_t FATFileSystem::_fast_seek_entries = 0;
 
 FATFileSystem::FATFileSystem(const char* n) : FileSystemLike(n) {
     FFSDEBUG("FATFileSystem(%s)\n", n);
@@ -109,7 +111,12 @@ FileHandle *FATFileSystem::open(const char* name, int flags) {
     if(flags & O_APPEND) {
         f_lseek(&fh, fh.fsize);
     }
-    return new FATFileHandle(fh);
+    FATFileHandle *handle = new FATFileHandle(fh);
+    if(_fast_seek_tbl != NULL && openmode == FA_READ) {
+        handle->fast_seek(_fast_seek_tbl, _fast_seek_entries);
+        _fast_seek_tbl = NULL;
+    }
+    return handle;
 }
 
 int FATFileSystem::remove(const char *filename) {
@@ -55,6 +55,14 @@ public:
     virtual int disk_sync() { return 0; }
     virtual int disk_sectors() = 0;
 
+    // the next file opened read only gets a cluster link map in tbl, pass NULL to cancel
+    // stdio gives no way back from a FILE* to its handle, so the table has to be handed over before fopen
+    static void fast_seek_next_open(DWORD *tbl, uint32_t entries) { _fast_seek_tbl = tbl; _fast_seek_entries = entries; }
+
+private:
+    static DWORD *_fast_seek_tbl;
+    static uint32_t _fast_seek_entries;
+
 };
 
 }
@@ -0,0 +1,170 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DiskBench.h"
+#include "disk.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+DiskBench::DiskBench(timer_fn now, idle_fn idle, char *buf, size_t buf_size)
+    : now(now), idle(idle), buf(buf), buf_size(buf_size & ~511), seed(12345)
+{
+}
+
+uint32_t DiskBench::random()
+{
+    // xorshift, only has to be spread out, and the same on every run
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+void DiskBench::begin(result_t& r)
+{
+    memset(&r, 0, sizeof(r));
+    r.ok = true;
+}
+
+void DiskBench::sample(result_t& r, uint32_t us, uint32_t bytes)
+{
+    if(r.ops < MAX_SAMPLES) {
+        samples[r.ops] = us;
+    } else {
+        uint32_t i = random() % (r.ops + 1);
+        if(i < MAX_SAMPLES) samples[i] = us;
+    }
+    r.ops++;
+    r.bytes += bytes;
+    r.busy_us += us;
+    if(us > r.max_us) r.max_us = us;
+    if(idle != nullptr) idle();
+}
+
+void DiskBench::end(result_t& r)
+{
+    size_t n = std::min(r.ops, (uint32_t)MAX_SAMPLES);
+    if(n == 0) return;
+    std::sort(samples, samples + n);
+    r.p50_us = samples[n / 2];
+    r.p99_us = samples[(n * 99) / 100];
+}
+
+DiskBench::result_t DiskBench::disk_sequential_read(MSD_Disk *disk, uint32_t first_sector, uint32_t bytes)
+{
+    result_t r;
+    begin(r);
+    uint32_t per_op = buf_size / 512;
+    uint32_t sector = first_sector;
+    while (r.bytes < bytes) {
+        uint32_t t = now();
+        if(disk->disk_read(buf, sector, per_op) != 0) {
+            r.ok = false;
+            break;
+        }
+        sample(r, now() - t, per_op * 512);
+        sector += per_op;
+    }
+    end(r);
+    return r;
+}
+
+DiskBench::result_t DiskBench::disk_random_read(MSD_Disk *disk, uint32_t sectors, uint32_t count)
+{
+    result_t r;
+    begin(r);
+    for (uint32_t i = 0; i < count && sectors > 0; ++i) {
+        uint32_t sector = random() % sectors;
+        uint32_t t = now();
+        if(disk->disk_read(buf, sector, 1) != 0) {
+            r.ok = false;
+            break;
+        }
+        sample(r, now() - t, 512);
+    }
+    end(r);
+    return r;
+}
+
+DiskBench::result_t DiskBench::file_write(const char *path, uint32_t bytes)
+{
+    result_t r;
+    begin(r);
+    for (size_t i = 0; i < buf_size; ++i) buf[i] = 'A' + (i % 26);
+
+    FILE *fp = fopen(path, "w");
+    if(fp == NULL) {
+        r.ok = false;
+        return r;
+    }
+    while (r.bytes < bytes) {
+        uint32_t t = now();
+        size_t n = fwrite(buf, 1, buf_size, fp);
+        // stdio buffers the data, flushing makes each op a real write to the card
+        fflush(fp);
+        sample(r, now() - t, n);
+        if(n != buf_size) {
+            r.ok = false;
+            break;
+        }
+    }
+    uint32_t t = now();
+    if(fclose(fp) != 0) r.ok = false;
+    r.busy_us += now() - t;
+    end(r);
+    return r;
+}
+
+DiskBench::result_t DiskBench::file_sequential_read(const char *path)
+{
+    result_t r;
+    begin(r);
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL) {
+        r.ok = false;
+        return r;
+    }
+    while (true) {
+        uint32_t t = now();
+        size_t n = fread(buf, 1, buf_size, fp);
+        if(n == 0) break;
+        sample(r, now() - t, n);
+    }
+    if(ferror(fp)) r.ok = false;
+    fclose(fp);
+    end(r);
+    return r;
+}
+
+DiskBench::result_t DiskBench::file_random_read(const char *path, uint32_t count)
+{
+    result_t r;
+    begin(r);
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL) {
+        r.ok = false;
+        return r;
+    }
+    // no stdio buffering, so each read is one 512 byte read of the file
+    setvbuf(fp, NULL, _IONBF, 0);
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    for (uint32_t i = 0; i < count && size >= 512; ++i) {
+        long ofs = (random() % (size / 512)) * 512;
+        uint32_t t = now();
+        if(fseek(fp, ofs, SEEK_SET) != 0 || fread(buf, 1, 512, fp) != 512) {
+            r.ok = false;
+            break;
+        }
+        sample(r, now() - t, 512);
+    }
+    fclose(fp);
+    end(r);
+    return r;
+}
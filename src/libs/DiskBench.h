@@ -0,0 +1,66 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DISKBENCH_H
+#define DISKBENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class MSD_Disk;
+
+// Throughput and latency measurement of a block device and of files on it
+// Only the operations themselves are timed, so the idle callback run between them does not skew the results.
+// Nothing here touches hardware directly, the clock and the idle callback are supplied by the caller
+class DiskBench {
+    public:
+        typedef uint32_t (*timer_fn)();  // microseconds
+        typedef void (*idle_fn)();
+
+        struct result_t {
+            uint32_t ops;
+            uint32_t bytes;
+            uint32_t busy_us;   // sum of the op times
+            uint32_t p50_us;
+            uint32_t p99_us;
+            uint32_t max_us;
+            bool ok;
+
+            uint32_t kb_per_s() const { return busy_us == 0 ? 0 : (uint64_t)bytes * 1000000 / 1024 / busy_us; }
+        };
+
+        // buf is the transfer buffer, a multiple of 512 bytes
+        DiskBench(timer_fn now, idle_fn idle, char *buf, size_t buf_size);
+
+        // raw sector access, reads only so the filesystem is never touched
+        result_t disk_sequential_read(MSD_Disk *disk, uint32_t first_sector, uint32_t bytes);
+        result_t disk_random_read(MSD_Disk *disk, uint32_t sectors, uint32_t count);
+
+        // through the filesystem, file_write creates the file the reads then use
+        result_t file_write(const char *path, uint32_t bytes);
+        result_t file_sequential_read(const char *path);
+        result_t file_random_read(const char *path, uint32_t count);
+
+    private:
+        static const size_t MAX_SAMPLES = 256;
+
+        void begin(result_t& r);
+        void sample(result_t& r, uint32_t us, uint32_t bytes);
+        void end(result_t& r);
+        uint32_t random();
+
+        timer_fn now;
+        idle_fn idle;
+        char *buf;
+        size_t buf_size;
+        uint32_t seed;
+
+        // latency samples, once full each new sample replaces a random one so all ops are equally represented
+        uint32_t samples[MAX_SAMPLES];
+};
+
+#endif
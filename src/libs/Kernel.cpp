@@ -17,7 +17,9 @@
 #include "ConfigValue.h"
 
 #include "libs/StepTicker.h"
+#include "Gcode.h"
 #include "libs/PublicData.h"
+#include "PublicDataRequest.h"
 #include "modules/communication/SerialConsole.h"
 #include "modules/communication/GcodeDispatch.h"
 #include "modules/robot/Planner.h"
@@ -46,8 +48,10 @@
 #include "platform_memory.h"
 
 #include <malloc.h>
+#include <string.h>
 #include <array>
 #include <string>
+#include <algorithm>
 #include "Kernel.h"
 
 #define laser_checksum CHECKSUM("laser")
@@ -60,16 +64,21 @@
 #define grbl_mode_checksum                          CHECKSUM("grbl_mode")
 #define feed_hold_enable_checksum                   CHECKSUM("enable_feed_hold")
 #define ok_per_line_checksum                        CHECKSUM("ok_per_line")
+#define status_report_interval_ms_checksum          CHECKSUM("status_report_interval_ms")
 
 Kernel* Kernel::instance;
 
 #define	EEP_MAX_PAGE_SIZE	32
 #define EEPROM_DATA_STARTPAGE	1
+#define EEP_WRITE_TIMEOUT_US	20000	// twice the longest write cycle of the 24Cxx parts
 // The kernel is the central point in Smoothie : it stores modules, and handles event calls
 Kernel::Kernel()
 {
     halted = false;
     feed_hold = false;
+    keyed_hook_count = 0;
+    profiling = false;
+    event_profile.fill({nullptr, 0, 0, 0});
     enable_feed_hold = false;
     bad_mcu= true;
     uploading = false;
@@ -81,6 +90,8 @@ Kernel::Kernel()
     suspending = false;
     halt_reason = MANUAL;
     atc_state = 0;
+    eeprom_pending = false;
+    eeprom_busy = false;
 
     instance = this; // setup the Singleton instance of the kernel
 
@@ -148,6 +159,12 @@ Kernel::Kernel()
     // we expect ok per line now not per G code, setting this to false will return to the old (incorrect) way of ok per G code
     this->ok_per_line = this->config->value( ok_per_line_checksum )->by_default(true)->as_bool();
 
+    // ? and * reports are served from a cache that is rebuilt at most this often
+    this->status_report_interval_us = this->config->value( status_report_interval_ms_checksum )->by_default(50)->as_number() * 1000;
+    this->query_cache.len = 0;
+    this->diagnose_cache.len = 0;
+    this->frame_cache.len = 0;
+
     this->add_module( this->serial );
 
     // HAL stuff
@@ -195,6 +212,7 @@ Kernel::Kernel()
     this->i2c->frequency(200000);
 
     this->eeprom_data = new(AHB0) EEPROM_data();
+    this->eeprom_shadow = new(AHB0) EEPROM_data();
     // read eeprom data
     this->read_eeprom_data();
 
@@ -233,11 +251,69 @@ uint8_t Kernel::get_state()
     }
 }
 
-// return a GRBL-like query string for serial ?
-std::string Kernel::get_query_string()
+// appends to a fixed report buffer, anything past the end is dropped
+// the last reserve bytes are kept for the terminator so a truncated report is still closed
+struct report_buf_t {
+    char *data;
+    size_t size;
+    size_t len;
+    size_t reserve;
+
+    report_buf_t& append(const char *s, size_t n) {
+        if(n > size - 1 - reserve - len) n = size - 1 - reserve - len;
+        memcpy(data + len, s, n);
+        len += n;
+        data[len] = '\0';
+        return *this;
+    }
+    report_buf_t& append(const char *s) { return append(s, strlen(s)); }
+    report_buf_t& terminate(const char *s) { reserve = 0; return append(s); }
+};
+
+// cheap fingerprint of the states that show in the reports, a change forces a rebuild before the interval is up
+uint32_t Kernel::report_fingerprint() const
+{
+    return (halted << 0) | (feed_hold << 1) | (sleeping << 2) | (suspending << 3) | (waiting << 4) | (zprobing << 5) |
+           (conveyor->is_queue_empty() << 6) | (atc_state << 8) | (halt_reason << 16);
+}
+
+// true when the cached report has to be rebuilt, and marks it as built now
+bool Kernel::refresh_report(report_cache_t& cache)
+{
+    uint32_t now = us_ticker_read();
+    uint32_t fp = report_fingerprint();
+    if(cache.len != 0 && fp == cache.fingerprint && now - cache.built_us < status_report_interval_us) return false;
+    cache.fingerprint = fp;
+    cache.built_us = now;
+    return true;
+}
+
+// return a GRBL-like query string for serial ?, rebuilt at most every status_report_interval_ms unless the state changed
+const char *Kernel::get_query_string()
+{
+    if(refresh_report(query_cache)) {
+        report_buf_t str = {query_report, sizeof(query_report), 0, 2};
+        build_query_string(str);
+        query_cache.len = str.len;
+    }
+    return query_report;
+}
+
+// sends the cached query string with the stream's own buffer state added, like grbl's Bf:planner blocks free,rx chars free
+void Kernel::send_query_string(StreamOutput *stream)
 {
+    const char *q = get_query_string();
+    int rx = stream->rx_free();
+    if(rx < 0 || query_cache.len < 2) {
+        stream->puts(q, query_cache.len);
+        return;
+    }
+    stream->puts(q, query_cache.len - 2); // without the >\n
+    stream->printf("|Bf:%u,%d>\n", conveyor->queue_free(), rx);
+}
 
-    std::string str;
+void Kernel::build_query_string(report_buf_t& str)
+{
     bool running = false;
     bool ok = false;
 
@@ -377,7 +453,7 @@ std::string Kernel::get_query_string()
 	void *returned_data;
 	ok = PublicData::get_value( player_checksum, get_progress_checksum, &returned_data );
 	if (ok) {
-		struct pad_progress p =  *static_cast<struct pad_progress *>(returned_data);
+		const struct pad_progress& p = *static_cast<struct pad_progress *>(returned_data);
 		n= snprintf(buf, sizeof(buf), "|P:%lu,%d,%lu", p.played_lines, p.percent_complete, p.elapsed_secs);
 		if(n > sizeof(buf)) n= sizeof(buf);
 		str.append(buf, n);
@@ -413,6 +489,12 @@ std::string Kernel::get_query_string()
         str.append(buf, n);
     }
 
+    // planner queue telemetry
+    if (conveyor->is_telemetry_in_status()) {
+        n = conveyor->format_telemetry(buf, sizeof(buf));
+        str.append(buf, n);
+    }
+
     // if halted
     if (halted) {
         n = snprintf(buf, sizeof(buf), "|H:%d", halt_reason);
@@ -420,15 +502,108 @@ std::string Kernel::get_query_string()
         str.append(buf, n);
     }
 
-    str.append(">\n");
-    return str;
+    str.terminate(">\n");
 }
 
 
-// return a Diagnose string
-std::string Kernel::get_diagnose_string()
+// compact binary version of the query string for clients that asked for it with $B1
+// fresh skips the cache for callers that pace themselves, like the udp telemetry stream
+size_t Kernel::get_status_frame(const uint8_t **frame, bool fresh)
+{
+    if(refresh_report(frame_cache) || fresh) {
+        build_status_frame(status_frame);
+        frame_cache.len = sizeof(status_frame);
+    }
+    *frame = reinterpret_cast<const uint8_t *>(&status_frame);
+    return frame_cache.len;
+}
+
+void Kernel::build_status_frame(status_frame_t& f)
+{
+    memset(&f, 0, sizeof(f));
+    f.sync[0] = STATUS_FRAME_SYNC0;
+    f.sync[1] = STATUS_FRAME_SYNC1;
+    f.length = sizeof(f) - 3;
+    f.version = STATUS_FRAME_VERSION;
+
+    uint8_t state = this->get_state();
+    f.state = state;
+    f.halt_reason = halted ? halt_reason : 0;
+    f.atc_state = atc_state;
+    f.flags = (feed_hold << 0) | (laser_mode << 1) | (vacuum_mode << 2) | ((robot->compensationTransform != nullptr) << 3);
+    f.time_ms = us_ticker_read() / 1000;
+    f.queue_depth = conveyor->queue_depth();
+
+    float mpos[3];
+    if(state == RUN || state == HOME) {
+        robot->get_current_machine_position(mpos);
+        if(robot->compensationTransform) robot->compensationTransform(mpos, true, false);
+    } else {
+        Robot::wcs_t m = robot->get_axis_position();
+        mpos[0] = std::get<X_AXIS>(m);
+        mpos[1] = std::get<Y_AXIS>(m);
+        mpos[2] = std::get<Z_AXIS>(m);
+    }
+    Robot::wcs_t wpos = robot->mcs2wcs(mpos);
+    for (int i = 0; i < 3; ++i) f.mpos[i] = robot->from_millimeters(mpos[i]);
+    f.wpos[0] = robot->from_millimeters(std::get<X_AXIS>(wpos));
+    f.wpos[1] = robot->from_millimeters(std::get<Y_AXIS>(wpos));
+    f.wpos[2] = robot->from_millimeters(std::get<Z_AXIS>(wpos));
+
+    f.feed[0] = (state == RUN || state == HOME) ? robot->from_millimeters(conveyor->get_current_feedrate() * 60.0F) : 0;
+    f.feed[1] = robot->from_millimeters(robot->get_feed_rate());
+    f.feed[2] = 6000.0F / robot->get_seconds_per_minute();
+
+    struct spindle_status ss;
+    if(PublicData::get_value(pwm_spindle_control_checksum, get_spindle_status_checksum, &ss)) {
+        f.spindle[0] = ss.current_rpm;
+        f.spindle[1] = ss.target_rpm;
+        f.spindle[2] = ss.factor;
+        f.spindle_pwm = ss.current_pwm_value;
+    }
+    struct pad_temperature temp;
+    if(PublicData::get_value(temperature_control_checksum, current_temperature_checksum, spindle_temperature_checksum, &temp)) {
+        f.spindle_temperature = temp.current_temperature;
+    }
+
+    struct tool_status tool;
+    f.tool = -1;
+    if(PublicData::get_value(atc_handler_checksum, get_tool_status_checksum, &tool)) {
+        f.tool = tool.active_tool;
+        f.tool_offset = tool.tool_offset;
+    }
+
+    void *returned_data;
+    if(PublicData::get_value(player_checksum, get_progress_checksum, &returned_data)) {
+        const struct pad_progress& p = *static_cast<struct pad_progress *>(returned_data);
+        f.played_lines = p.played_lines;
+        f.percent_complete = p.percent_complete;
+        f.elapsed_secs = p.elapsed_secs;
+    }
+
+    // fletcher-16 over everything after the length byte
+    const uint8_t *b = reinterpret_cast<const uint8_t *>(&f);
+    uint16_t s1 = 0, s2 = 0;
+    for (size_t i = 3; i < sizeof(f) - 2; ++i) {
+        s1 = (s1 + b[i]) % 255;
+        s2 = (s2 + s1) % 255;
+    }
+    f.checksum = (s2 << 8) | s1;
+}
+
+// return a Diagnose string, cached like the query string
+const char *Kernel::get_diagnose_string()
+{
+    if(refresh_report(diagnose_cache)) {
+        report_buf_t str = {diagnose_report, sizeof(diagnose_report), 0, 2};
+        build_diagnose_string(str);
+        diagnose_cache.len = str.len;
+    }
+    return diagnose_report;
+}
+
+void Kernel::build_diagnose_string(report_buf_t& str)
 {
-	std::string str;
     size_t n;
     char buf[128];
     bool ok = false;
@@ -526,8 +701,7 @@ std::string Kernel::get_diagnose_string()
         str.append(buf, n);
     }
 
-    str.append("}\n");
-    return str;
+    str.terminate("}\n");
 }
 
 // Add a module to Kernel. We don't actually hold a list of modules we just call its on_module_loaded
@@ -536,15 +710,134 @@ void Kernel::add_module(Module* module)
     module->on_module_loaded();
 }
 
+#define GCODE_HOOK_KEY(letter, code) ((letter) == 'M' ? 0x4000 | (code) : (code))
+#define PUBLIC_DATA_HOOK_KEY(csa, csb) (((uint32_t)(csa) << 16) | (csb))
+#define HOOK_ANY 0xFFFFFFFF
+
+static bool is_keyed_event(_EVENT_ENUM id_event)
+{
+    return id_event == ON_GCODE_RECEIVED || id_event == ON_GET_PUBLIC_DATA || id_event == ON_SET_PUBLIC_DATA;
+}
+
 // Adds a hook for a given module and event
 void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod)
 {
     this->hooks[id_event].push_back(mod);
+    if(is_keyed_event(id_event)) {
+        // this module wants all of them
+        add_keyed_hook(id_event, HOOK_ANY, mod);
+    }
+}
+
+// Adds a hook for a module that only handles G<code> or M<code>, so other gcodes are not passed to it
+void Kernel::register_for_gcode(char letter, uint16_t code, Module *mod)
+{
+    add_keyed_hook(ON_GCODE_RECEIVED, GCODE_HOOK_KEY(letter, code), mod);
+}
+
+// Adds a hook for a module that only provides public data starting with csa, and csb if it is not 0
+void Kernel::register_for_public_data(_EVENT_ENUM id_event, uint16_t csa, uint16_t csb, Module *mod)
+{
+    add_keyed_hook(id_event, PUBLIC_DATA_HOOK_KEY(csa, csb), mod);
+}
+
+void Kernel::add_keyed_hook(_EVENT_ENUM id_event, uint32_t key, Module *mod)
+{
+    std::vector<keyed_hook_t>& v = keyed_hooks[id_event];
+    auto it = std::upper_bound(v.begin(), v.end(), key, [](uint32_t k, const keyed_hook_t& h) { return k < h.key; });
+    // a module registering the same key twice still only gets called once
+    for (auto i = std::lower_bound(v.begin(), it, key, [](const keyed_hook_t& h, uint32_t k) { return h.key < k; }); i != it; ++i) {
+        if(i->module == mod) return;
+    }
+    v.insert(it, {key, keyed_hook_count++, mod});
+}
+
+// calls the modules hooked under any of the keys and the catch all ones, merged back into registration order
+void Kernel::call_keyed_hooks(_EVENT_ENUM id_event, const uint32_t keys[], int nkeys, void *argument)
+{
+    std::vector<keyed_hook_t>& v = keyed_hooks[id_event];
+    auto by_key = [](const keyed_hook_t& h, uint32_t k) { return h.key < k; };
+    size_t pos[4], end[4];
+    int n = 0;
+    for (int k = 0; k <= nkeys && n < 4; ++k) {
+        uint32_t key = (k < nkeys) ? keys[k] : HOOK_ANY;
+        if(k > 0 && k < nkeys && key == keys[k - 1]) continue;
+        pos[n] = std::lower_bound(v.begin(), v.end(), key, by_key) - v.begin();
+        for (end[n] = pos[n]; end[n] < v.size() && v[end[n]].key == key; ++end[n]) ;
+        if(pos[n] < end[n]) ++n;
+    }
+
+    while(true) {
+        int next = -1;
+        for (int k = 0; k < n; ++k) {
+            if(pos[k] < end[k] && (next < 0 || v[pos[k]].order < v[pos[next]].order)) next = k;
+        }
+        if(next < 0) break;
+        call_module(id_event, v[pos[next]++].module, argument);
+    }
+}
+
+void Kernel::call_module(_EVENT_ENUM id_event, Module *m, void *argument)
+{
+    if(!this->profiling) {
+        (m->*kernel_callback_functions[id_event])(argument);
+        return;
+    }
+
+    uint32_t start = DWT->CYCCNT;
+    (m->*kernel_callback_functions[id_event])(argument);
+    uint32_t cycles = DWT->CYCCNT - start;
+
+    // the table was filled when profiling started, so nothing is allocated here
+    for (auto& p : module_profile[id_event]) {
+        if(p.module == m) {
+            p.calls++;
+            p.total_cycles += cycles;
+            if(cycles > p.max_cycles) p.max_cycles = cycles;
+            break;
+        }
+    }
 }
 
 // Call a specific event with an argument
 void Kernel::call_event(_EVENT_ENUM id_event, void * argument)
 {
+    // the whole event is timed here, the inner call does the dispatch and times each module
+    if(this->profiling) {
+        uint32_t start = DWT->CYCCNT;
+        dispatch_event(id_event, argument);
+        uint32_t cycles = DWT->CYCCNT - start;
+        if(this->profiling) {
+            profile_t& p = event_profile[id_event];
+            p.calls++;
+            p.total_cycles += cycles;
+            if(cycles > p.max_cycles) p.max_cycles = cycles;
+        }
+        return;
+    }
+    dispatch_event(id_event, argument);
+}
+
+void Kernel::dispatch_event(_EVENT_ENUM id_event, void * argument)
+{
+    if(id_event == ON_GCODE_RECEIVED) {
+        Gcode *gcode = static_cast<Gcode*>(argument);
+        uint32_t key = gcode->has_g ? GCODE_HOOK_KEY('G', gcode->g) : GCODE_HOOK_KEY('M', gcode->m);
+        call_keyed_hooks(id_event, &key, (gcode->has_g || gcode->has_m) ? 1 : 0, argument);
+        return;
+    }
+
+    if(id_event == ON_GET_PUBLIC_DATA || id_event == ON_SET_PUBLIC_DATA) {
+        PublicDataRequest *pdr = static_cast<PublicDataRequest*>(argument);
+        uint32_t keys[2] = { PUBLIC_DATA_HOOK_KEY(pdr->get_target(0), pdr->get_target(1)), PUBLIC_DATA_HOOK_KEY(pdr->get_target(0), 0) };
+        call_keyed_hooks(id_event, keys, 2, argument);
+        return;
+    }
+
+    if(id_event == ON_IDLE && (eeprom_pending || eeprom_busy)) {
+        eeprom_write_step();
+    }
+
     bool was_idle = true;
     if(id_event == ON_HALT) {
         this->halted = (argument == nullptr);
@@ -554,7 +847,7 @@ void Kernel::call_event(_EVENT_ENUM id_event, void * argument)
 
     // send to all registered modules
     for (auto m : hooks[id_event]) {
-        (m->*kernel_callback_functions[id_event])(argument);
+        call_module(id_event, m, argument);
     }
 
     if(id_event == ON_HALT) {
@@ -578,6 +871,11 @@ bool Kernel::kernel_has_event(_EVENT_ENUM id_event, Module *mod)
 
 void Kernel::unregister_for_event(_EVENT_ENUM id_event, Module *mod)
 {
+    if(is_keyed_event(id_event)) {
+        // drops the key specific hooks too
+        std::vector<keyed_hook_t>& v = keyed_hooks[id_event];
+        v.erase(std::remove_if(v.begin(), v.end(), [mod](const keyed_hook_t& h) { return h.module == mod; }), v.end());
+    }
     for (auto i = hooks[id_event].begin(); i != hooks[id_event].end(); ++i) {
         if(*i == mod) {
             hooks[id_event].erase(i);
@@ -586,6 +884,64 @@ void Kernel::unregister_for_event(_EVENT_ENUM id_event, Module *mod)
     }
 }
 
+static const char *event_names[NUMBER_OF_DEFINED_EVENTS] = {
+    "main_loop", "console_line", "gcode", "idle", "second_tick", "get_public_data", "set_public_data", "halt", "enable"
+};
+
+void Kernel::set_profiling(bool f)
+{
+    if(f && !this->profiling) {
+        // start the cycle counter, it runs at the core clock and wraps after ~40s so single calls are always measured right
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        reset_profile();
+    }
+    this->profiling = f;
+}
+
+void Kernel::reset_profile()
+{
+    bool was_profiling = this->profiling;
+    this->profiling = false;
+    for (int i = 0; i < NUMBER_OF_DEFINED_EVENTS; ++i) {
+        event_profile[i] = {nullptr, 0, 0, 0};
+        // one entry for every module hooked on this event, by either kind of hook
+        std::vector<profile_t>& v = module_profile[i];
+        v.clear();
+        for (auto m : hooks[i]) {
+            v.push_back({m, 0, 0, 0});
+        }
+        for (auto& h : keyed_hooks[i]) {
+            if(std::find_if(v.begin(), v.end(), [&h](const profile_t& p) { return p.module == h.module; }) == v.end()) {
+                v.push_back({h.module, 0, 0, 0});
+            }
+        }
+    }
+    this->profiling = was_profiling;
+}
+
+// modules are shown by their vtable address, look it up in the map file to get the class
+void Kernel::print_profile(StreamOutput *stream)
+{
+    uint32_t cpu_mhz = SystemCoreClock / 1000000;
+    stream->printf("profiling is %s, times in us at %luMHz\n", this->profiling ? "on" : "off", cpu_mhz);
+    stream->printf("%-16s %10s %10s %10s\n", "event", "calls", "avg", "max");
+    for (int i = 0; i < NUMBER_OF_DEFINED_EVENTS; ++i) {
+        const profile_t& e = event_profile[i];
+        if(e.calls == 0) continue;
+        stream->printf("%-16s %10lu %10lu %10lu\n", event_names[i], e.calls, (uint32_t)(e.total_cycles / e.calls / cpu_mhz), e.max_cycles / cpu_mhz);
+    }
+
+    stream->printf("%-16s %-10s %10s %10s %10s %10s\n", "event", "vtable", "calls", "avg", "max", "total ms");
+    for (int i = 0; i < NUMBER_OF_DEFINED_EVENTS; ++i) {
+        for (auto& p : module_profile[i]) {
+            if(p.calls == 0) continue;
+            stream->printf("%-16s 0x%08lX %10lu %10lu %10lu %10lu\n", event_names[i], *(uint32_t *)p.module, p.calls,
+                           (uint32_t)(p.total_cycles / p.calls / cpu_mhz), p.max_cycles / cpu_mhz, (uint32_t)(p.total_cycles / cpu_mhz / 1000));
+        }
+    }
+}
+
 void Kernel::read_eeprom_data()
 {
 	size_t size = sizeof(EEPROM_data);
@@ -612,43 +968,74 @@ void Kernel::read_eeprom_data()
     wait(0.05);
 
     memcpy(this->eeprom_data, i2c_buffer, size);
+    memcpy(this->eeprom_shadow, i2c_buffer, size);
 }
 
-void Kernel::write_eeprom_data()
+// writes the dirty bytes of the next page that has any, returns false once there is nothing left to do
+// never waits for the chip, a write cycle in progress is polled on the next call
+bool Kernel::eeprom_write_step()
 {
-	size_t size = sizeof(EEPROM_data);
-	char Data_buffer[size];
-	unsigned int writenum = 0;
-	unsigned int result = 0;
-	unsigned int pagenum = 0;
-	unsigned int bytenum =0;
-	unsigned char * writeptr = 0;
-	unsigned int u8Pagebegin=EEPROM_DATA_STARTPAGE;
+    if(eeprom_busy) {
+        // the chip does not acknowledge its address until the write cycle is done
+        if(!eeprom_ready()) {
+            if(us_ticker_read() - eeprom_write_us < EEP_WRITE_TIMEOUT_US) return true;
+            this->streams->printf("ALARM: EEPROM data write timeout\n");
+        }
+        eeprom_busy = false;
+    }
+    if(!eeprom_pending) return false;
+
+    const unsigned char *data = (const unsigned char *)this->eeprom_data;
+    unsigned char *shadow = (unsigned char *)this->eeprom_shadow;
+    const size_t size = sizeof(EEPROM_data);
+    size_t first = 0;
+    while(first < size && data[first] == shadow[first]) first++;
+    if(first == size) {
+        eeprom_pending = false;
+        return false;
+    }
 
-	memcpy(Data_buffer, this->eeprom_data, size);
+    // from the first dirty byte to the last one in the same page, a page write wraps around at the page end
+    const unsigned int base = EEPROM_DATA_STARTPAGE * EEP_MAX_PAGE_SIZE;
+    size_t end = ((base + first) / EEP_MAX_PAGE_SIZE + 1) * EEP_MAX_PAGE_SIZE - base;
+    if(end > size) end = size;
+    while(data[end - 1] == shadow[end - 1]) end--;
+
+    unsigned char page[EEP_MAX_PAGE_SIZE];
+    size_t n = end - first;
+    memcpy(page, data + first, n);
+    if(iic_write(base + first, n, page) != 0) {
+        this->streams->printf("ALARM: EEPROM data write error:%u\n", (base + first) / EEP_MAX_PAGE_SIZE);
+        eeprom_pending = false;
+        return false;
+    }
+    memcpy(shadow + first, page, n);
+    eeprom_write_us = us_ticker_read();
+    eeprom_busy = true;
+    return true;
+}
 
-	writeptr = (unsigned char *)Data_buffer;
-	while(writenum < size)
-	{
-		bytenum = (size-pagenum*EEP_MAX_PAGE_SIZE) >= EEP_MAX_PAGE_SIZE ? EEP_MAX_PAGE_SIZE : size-pagenum*EEP_MAX_PAGE_SIZE;
-		result = iic_page_write(u8Pagebegin+pagenum, bytenum, (unsigned char *)writeptr);
-		wait(0.1);
-		if(result == 0)
-		{
-			pagenum ++;
-			writenum += bytenum;
-			writeptr += bytenum;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (result != 0) {
-		this->streams->printf("ALARM: EEPROM data write error:%d\n",pagenum);
-	} else {
-//		this->streams->printf("EEPROM data write finished.\n");
-	}
+void Kernel::flush_eeprom_data()
+{
+    while(eeprom_write_step()) ;
+}
+
+// acknowledge polling, true once the chip has finished its write cycle
+bool Kernel::eeprom_ready()
+{
+    this->i2c->start();
+    bool ack = this->i2c->write(0xA0) == 1;
+    this->i2c->stop();
+    return ack;
+}
+
+bool Kernel::eeprom_wait_ready()
+{
+    uint32_t start = us_ticker_read();
+    while(!eeprom_ready()) {
+        if(us_ticker_read() - start >= EEP_WRITE_TIMEOUT_US) return false;
+    }
+    return true;
 }
 
 void Kernel::erase_eeprom_data()
@@ -663,6 +1050,7 @@ void Kernel::erase_eeprom_data()
 	unsigned int u8Pagebegin=EEPROM_DATA_STARTPAGE;
 
 	memset(Data_buffer, 0, sizeof(Data_buffer));
+	flush_eeprom_data();
 
 
 	writeptr = (unsigned char *)Data_buffer;
@@ -670,7 +1058,7 @@ void Kernel::erase_eeprom_data()
 	{
 		bytenum = (size-pagenum*EEP_MAX_PAGE_SIZE) >= EEP_MAX_PAGE_SIZE ? EEP_MAX_PAGE_SIZE : size-pagenum*EEP_MAX_PAGE_SIZE;
 		result = iic_page_write(u8Pagebegin+pagenum, bytenum, (unsigned char *)writeptr);
-		wait(0.05);
+		if(result == 0 && !eeprom_wait_ready()) result = 1;
 		if(result == 0)
 		{
 			pagenum ++;
@@ -685,19 +1073,23 @@ void Kernel::erase_eeprom_data()
 	if (result != 0) {
 		this->streams->printf("ALARM: EEPROM data erase error.\n");
 	} else {
+		memset(this->eeprom_shadow, 0, size);
 		this->streams->printf("EEPROM data erase finished.\n");
 	}
 }
 int Kernel::iic_page_write(unsigned char u8PageNum, unsigned char u8len, unsigned char *pu8Array)
+{
+	return iic_write((unsigned int)u8PageNum << 5, u8len, pu8Array);
+}
+
+// writes up to the end of the page u16ByteAdd is in, returns 1 if the chip did not answer
+int Kernel::iic_write(unsigned int u16ByteAdd, unsigned char u8len, const unsigned char *pu8Array)
 {
 	unsigned char   i;
-	unsigned int  	u16ByteAdd;
 	unsigned char   u8HighAdd;
 	unsigned char   u8LowAdd;
-	unsigned char   *pu8ByteArray;
+	int             ack;
 
-	u16ByteAdd = (unsigned int)u8PageNum;
-	u16ByteAdd = (u16ByteAdd<<5);
 	u8LowAdd = (unsigned char)u16ByteAdd;
 	u8HighAdd = (unsigned char)(u16ByteAdd>>8);
 
@@ -708,23 +1100,20 @@ int Kernel::iic_page_write(unsigned char u8PageNum, unsigned char u8len, unsigne
 
 
 	this->i2c->start();
-	this->i2c->write(0xA0);
+	ack = this->i2c->write(0xA0);
 
 	this->i2c->write(u8HighAdd);
 	this->i2c->write(u8LowAdd);
 
-	pu8ByteArray = pu8Array;
-
 	/* write the array to eeprom */
 	for(i=0;i<u8len;i++)
 	{
-		this->i2c->write(*pu8ByteArray);
-		pu8ByteArray++;
+		this->i2c->write(pu8Array[i]);
 	}
 
 	this->i2c->stop();
 	this->i2c->stop();
 
-	return 0;
+	return ack == 1 ? 0 : 1;
 }
 
@@ -35,6 +35,8 @@ class Adc;
 class PublicData;
 class SimpleShell;
 class Configurator;
+class Gcode;
+class StreamOutput;
 
 enum STATE {
 	IDLE    = 0,
@@ -96,6 +98,36 @@ typedef struct {
     float perm_vars[20];
 } EEPROM_data;
 
+struct report_buf_t;
+
+// binary status frame sent instead of the ? string once a client sends $B1, little endian
+#define STATUS_FRAME_SYNC0 0xA5
+#define STATUS_FRAME_SYNC1 0x5A
+#define STATUS_FRAME_VERSION 2
+typedef struct __attribute__((packed)) {
+	uint8_t sync[2];
+	uint8_t length;             // bytes following this one, including the checksum
+	uint8_t version;
+	uint8_t state;              // STATE
+	uint8_t halt_reason;        // 0 when not halted
+	uint8_t atc_state;
+	uint8_t flags;              // bit0 feed hold, bit1 laser mode, bit2 vacuum mode, bit3 auto leveling
+	uint32_t time_ms;           // when the frame was built
+	float mpos[3];
+	float wpos[3];
+	float feed[3];              // current, requested, override %
+	float spindle[3];           // current rpm, target rpm, override %
+	float spindle_pwm;          // spindle load as the pwm duty the controller needs
+	float spindle_temperature;
+	uint8_t queue_depth;        // planner blocks queued
+	int16_t tool;
+	float tool_offset;
+	uint32_t played_lines;
+	uint8_t percent_complete;
+	uint32_t elapsed_secs;
+	uint16_t checksum;          // fletcher-16 from version up to here
+} status_frame_t;
+
 class Kernel {
     public:
         Kernel();
@@ -103,6 +135,7 @@ class Kernel {
         ~Kernel() {
             delete this->i2c;
             delete this->eeprom_data;
+            delete this->eeprom_shadow;
         }
 
         static Kernel* instance; // the Singleton instance of Kernel usable anywhere
@@ -110,6 +143,8 @@ class Kernel {
 
         void add_module(Module* module);
         void register_for_event(_EVENT_ENUM id_event, Module *module);
+        void register_for_gcode(char letter, uint16_t code, Module *module);
+        void register_for_public_data(_EVENT_ENUM id_event, uint16_t csa, uint16_t csb, Module *module);
         void call_event(_EVENT_ENUM id_event, void * argument= nullptr);
 
         bool kernel_has_event(_EVENT_ENUM id_event, Module *module);
@@ -162,12 +197,21 @@ class Kernel {
         uint8_t get_atc_state() const { return atc_state; }
 
         void read_eeprom_data();
-        void write_eeprom_data();
+        // queues what changed in eeprom_data, it is written from on_idle a page at a time
+        void write_eeprom_data() { eeprom_pending = true; }
+        // blocks until everything queued is on the chip
+        void flush_eeprom_data();
         void erase_eeprom_data();
 
-        std::string get_query_string();
+        const char *get_query_string();
+        void send_query_string(StreamOutput *stream);
+        const char *get_diagnose_string();
+        size_t get_status_frame(const uint8_t **frame, bool fresh = false);
 
-        std::string get_diagnose_string();
+        void set_profiling(bool f);
+        bool is_profiling() const { return profiling; }
+        void reset_profile();
+        void print_profile(StreamOutput *stream);
 
         // These modules are available to all other modules
         SerialConsole*    serial;
@@ -195,7 +239,53 @@ class Kernel {
     private:
         // When a module asks to be called for a specific event ( a hook ), this is where that request is remembered
         mbed::I2C* i2c;
+        EEPROM_data *eeprom_shadow; // what the chip holds, bytes of eeprom_data that differ from it are dirty
+        uint32_t eeprom_write_us;   // when the write cycle in progress started
         std::array<std::vector<Module*>, NUMBER_OF_DEFINED_EVENTS> hooks;
+
+        // gcode and public data handlers sorted by the code or checksums they asked for, catch all modules are under HOOK_ANY
+        // order is the registration order so an event still reaches its modules in the same sequence as the broadcast did
+        struct keyed_hook_t {
+            uint32_t key;
+            uint16_t order;
+            Module *module;
+        };
+        std::array<std::vector<keyed_hook_t>, NUMBER_OF_DEFINED_EVENTS> keyed_hooks;
+        uint16_t keyed_hook_count;
+        void add_keyed_hook(_EVENT_ENUM id_event, uint32_t key, Module *mod);
+        void call_keyed_hooks(_EVENT_ENUM id_event, const uint32_t keys[], int nkeys, void *argument);
+        uint32_t report_fingerprint() const;
+        void build_query_string(report_buf_t& str);
+        void build_diagnose_string(report_buf_t& str);
+        void build_status_frame(status_frame_t& f);
+
+        // last built ? and * reports and binary frame, len 0 means not built yet
+        struct report_cache_t {
+            size_t len;
+            uint32_t fingerprint;
+            uint32_t built_us;
+        };
+        bool refresh_report(report_cache_t& cache);
+        char query_report[320];
+        char diagnose_report[128];
+        status_frame_t status_frame;
+        report_cache_t query_cache;
+        report_cache_t diagnose_cache;
+        report_cache_t frame_cache;
+        uint32_t status_report_interval_us;
+
+        void dispatch_event(_EVENT_ENUM id_event, void *argument);
+        void call_module(_EVENT_ENUM id_event, Module *m, void *argument);
+
+        // DWT cycle counts of each module's callback and of each whole event call, only gathered while profiling
+        struct profile_t {
+            Module *module;
+            uint32_t calls;
+            uint32_t max_cycles;
+            uint64_t total_cycles;
+        };
+        std::array<std::vector<profile_t>, NUMBER_OF_DEFINED_EVENTS> module_profile;
+        std::array<profile_t, NUMBER_OF_DEFINED_EVENTS> event_profile;
         struct {
             bool use_leds:1;
             bool halted:1;
@@ -213,7 +303,14 @@ class Kernel {
             bool waiting: 1;
             bool aborted: 1;
             bool zprobing:1;
+            bool profiling:1;
+            bool eeprom_pending:1;
+            bool eeprom_busy:1;
         };
+        bool eeprom_write_step();
+        bool eeprom_ready();
+        bool eeprom_wait_ready();
+        int iic_write(unsigned int u16ByteAdd, unsigned char u8len, const unsigned char *pu8Array);
         int iic_page_write(unsigned char u8PageNum, unsigned char u8len, unsigned char *pu8Array);
 
 };
@@ -0,0 +1,68 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LineBuffer.h"
+#include "platform_memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool LineBuffer::init(size_t n)
+{
+    // one slot is always left empty to tell full from empty
+    n += 1;
+    void *v = AHB0.alloc(n);
+    if(v == nullptr) v = malloc(n);
+    if(v == nullptr) return false;
+    ring = static_cast<char *>(v);
+    size = n;
+    head = tail = 0;
+    lines_in = lines_out = 0;
+    return true;
+}
+
+bool LineBuffer::put(char c)
+{
+    if(size == 0) return false;
+    size_t next = (head + 1) % size;
+    if(next == tail) {
+        // full, a newline still has to end the line so it replaces the last char and the line is truncated
+        size_t last = (head + size - 1) % size;
+        if(c == '\n' && ring[last] != '\n') {
+            ring[last] = '\n';
+            lines_in++;
+        }
+        return false;
+    }
+    ring[head] = c;
+    head = next;
+    if(c == '\n') lines_in++;
+    return true;
+}
+
+bool LineBuffer::get_line(std::string& line)
+{
+    if(!has_line()) return false;
+
+    size_t h = head;
+    size_t t = tail;
+    // the line is in the span up to the end of the ring, or wraps into the start of it
+    size_t first = (h >= t) ? h - t : size - t;
+    const char *nl = static_cast<const char *>(memchr(ring + t, '\n', first));
+    if(nl != nullptr) {
+        line.assign(ring + t, nl - (ring + t));
+        t += (nl - (ring + t)) + 1;
+    } else {
+        nl = static_cast<const char *>(memchr(ring, '\n', h));
+        line.assign(ring + t, first);
+        line.append(ring, nl - ring);
+        t = (nl - ring) + 1;
+    }
+    tail = t % size;
+    lines_out++;
+    return true;
+}
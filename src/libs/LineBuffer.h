@@ -0,0 +1,44 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LINEBUFFER_H
+#define LINEBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Receive ring for console streams, single producer (the receive ISR) and single consumer (the main loop)
+// The producer counts completed lines so the consumer never has to scan for '\n',
+// and a line is taken out with at most two copies of the contiguous parts of the ring
+class LineBuffer {
+    public:
+        LineBuffer() : ring(nullptr), size(0), head(0), tail(0), lines_in(0), lines_out(0) {}
+
+        // allocates the ring in AHB0 if it fits, size is the number of chars it can hold
+        bool init(size_t size);
+
+        // called from the ISR, returns false if the char had to be dropped
+        bool put(char c);
+
+        bool has_line() const { return lines_in != lines_out; }
+        size_t free() const { return size - 1 - used(); }
+        size_t used() const { return (head + size - tail) % size; }
+
+        // pops the next complete line without its '\n', returns false if there is none
+        bool get_line(std::string& line);
+
+    private:
+        char *ring;
+        size_t size;
+        volatile size_t head;
+        volatile size_t tail;
+        volatile uint32_t lines_in;
+        volatile uint32_t lines_out;
+};
+
+#endif
@@ -32,3 +32,11 @@ void Module::register_for_event(_EVENT_ENUM event_id){
     // You add things to Smoothie by making a new class that inherits the Module class. See http://smoothieware.org/moduleexample for a crude introduction
     THEKERNEL->register_for_event(event_id, this);
 }
+
+void Module::register_for_gcode(char letter, uint16_t code){
+    THEKERNEL->register_for_gcode(letter, code, this);
+}
+
+void Module::register_for_public_data(_EVENT_ENUM event_id, uint16_t csa, uint16_t csb){
+    THEKERNEL->register_for_public_data(event_id, csa, csb, this);
+}
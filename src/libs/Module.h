@@ -8,6 +8,8 @@
 #ifndef MODULE_H
 #define MODULE_H
 
+#include <stdint.h>
+
 // See : http://smoothieware.org/listofevents
 // When adding a new event the virtual method needs to be defined in class Module and the method pointer need to be defined in
 // Module.cpp:16 in the same order
@@ -38,6 +40,10 @@ public:
     virtual void on_module_loaded() {};
 
     void register_for_event(_EVENT_ENUM event_id);
+    // instead of ON_GCODE_RECEIVED, only get called for G<code> (letter 'G') or M<code> (letter 'M')
+    void register_for_gcode(char letter, uint16_t code);
+    // instead of ON_GET/SET_PUBLIC_DATA, only get called for requests starting with csa, and csb if it is not 0
+    void register_for_public_data(_EVENT_ENUM event_id, uint16_t csa, uint16_t csb = 0);
 
     // event callbacks, not every module will implement all of these
     // there should be one for each _EVENT_ENUM
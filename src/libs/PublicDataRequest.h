@@ -19,6 +19,7 @@ class PublicDataRequest {
         bool starts_with(uint16_t addr) const { return addr == this->target[0]; }
         bool second_element_is(uint16_t addr) const { return addr == this->target[1]; }
         bool third_element_is(uint16_t addr) const { return addr == this->target[2]; }
+        uint16_t get_target(int i) const { return this->target[i]; }
 
         bool is_taken() const { return this->data_taken; }
         void set_taken() { this->data_taken= true; }
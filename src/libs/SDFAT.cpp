@@ -1,13 +1,20 @@
 #include "SDFAT.h"
 
-SDFAT::SDFAT(const char *n, MSD_Disk *disk) : mbed::FATFileSystem(n)
+SDFAT::SDFAT(const char *n, MSD_Disk *disk) : mbed::FATFileSystem(n), cache(disk)
 {
     d = disk;
+    generation = 0;
 }
 
 int SDFAT::disk_initialize()
 {
-    return d->disk_initialize();
+    int rc = d->disk_initialize();
+    // the card may have been written over USB or swapped since the last mount
+    cache.init(SDFAT_CACHE_SLOTS, SDFAT_READAHEAD_SECTORS);
+    cache.invalidate();
+    generation++;
+    cache.set_sectors(rc == 0 ? d->disk_sectors() : 0);
+    return rc;
 }
 
 int SDFAT::disk_status()
@@ -17,12 +24,14 @@ int SDFAT::disk_status()
 
 int SDFAT::disk_read(char *buffer, uint32_t sector, uint32_t count)
 {
-    return d->disk_read(buffer, sector, count);
+    // database is only known once the volume is mounted, until then everything is read as data
+    cache.set_metadata_limit(_fs.database);
+    return cache.read(buffer, sector, count);
 }
 
 int SDFAT::disk_write(const char *buffer, uint32_t sector, uint32_t count)
 {
-    return d->disk_write(buffer, sector, count);
+    return cache.write(buffer, sector, count);
 }
 
 int SDFAT::disk_sync()
@@ -36,6 +45,8 @@ int SDFAT::disk_sectors()
 }
 int SDFAT::remount() {
     f_mount(_fsid, NULL);
+    cache.invalidate();
+    generation++;
     f_mount(_fsid, &_fs);
     
 	return 0;
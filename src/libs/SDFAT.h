@@ -3,6 +3,11 @@
 
 #include "disk.h"
 #include "FATFileSystem.h"
+#include "SectorCache.h"
+
+// sectors of FAT kept in the LRU and data sectors fetched ahead of sequential reads
+#define SDFAT_CACHE_SLOTS 4
+#define SDFAT_READAHEAD_SECTORS 8
 
 class SDFAT : public mbed::FATFileSystem {
 public:
@@ -16,9 +21,16 @@ public:
     virtual int disk_sectors();
 
     int remount();
+    SectorCache& get_cache() { return cache; }
+    // changes on remount and on dir_changed, so directory listings can be cached
+    uint32_t get_generation() const { return generation; }
+    // to be called by whatever adds, removes or renames files or folders
+    void dir_changed() { generation++; }
 
 protected:
     MSD_Disk *d;
+    SectorCache cache;
+    uint32_t generation;
 };
 
 #endif /* _SDFAT_H */
@@ -0,0 +1,154 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SectorCache.h"
+#include "disk.h"
+#include "platform_memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_SECTOR 0xFFFFFFFFUL
+
+SectorCache::SectorCache(MSD_Disk *disk) : disk(disk)
+{
+    data = nullptr;
+    tags = nullptr;
+    slots = window = 0;
+    metadata_limit = 0;
+    sectors = 0;
+    memset(&stats, 0, sizeof(stats));
+    invalidate();
+}
+
+bool SectorCache::init(uint8_t n_slots, uint8_t n_window)
+{
+    if(data != nullptr) return true;
+
+    // sectors first so they stay word aligned, the slot tags go at the end
+    size_t n = (n_slots + n_window) * SECTOR_SIZE + n_slots * sizeof(tag_t);
+    void *v = AHB1.alloc(n);
+    if(v == nullptr) v = malloc(n);
+    if(v == nullptr) return false;
+
+    data = static_cast<char *>(v);
+    tags = reinterpret_cast<tag_t *>(data + (n_slots + n_window) * SECTOR_SIZE);
+    slots = n_slots;
+    window = n_window;
+    invalidate();
+    return true;
+}
+
+void SectorCache::invalidate()
+{
+    for (uint8_t i = 0; i < slots; ++i) {
+        tags[i].sector = NO_SECTOR;
+        tags[i].used = 0;
+    }
+    window_first = NO_SECTOR;
+    window_count = 0;
+    next_sector = NO_SECTOR;
+    use_count = 0;
+}
+
+int SectorCache::read_metadata(char *buffer, uint32_t sector)
+{
+    uint8_t victim = 0;
+    for (uint8_t i = 0; i < slots; ++i) {
+        if(tags[i].sector == sector) {
+            tags[i].used = ++use_count;
+            memcpy(buffer, slot_data(i), SECTOR_SIZE);
+            stats.hits++;
+            return 0;
+        }
+        if(tags[i].used < tags[victim].used) victim = i;
+    }
+
+    stats.misses++;
+    int rc = disk->disk_read(slot_data(victim), sector, 1);
+    if(rc != 0) {
+        tags[victim].sector = NO_SECTOR;
+        tags[victim].used = 0;
+        return rc;
+    }
+    tags[victim].sector = sector;
+    tags[victim].used = ++use_count;
+    memcpy(buffer, slot_data(victim), SECTOR_SIZE);
+    return 0;
+}
+
+int SectorCache::read(char *buffer, uint32_t sector, uint32_t count)
+{
+    if(data == nullptr) return disk->disk_read(buffer, sector, count);
+
+    while (count > 0) {
+        if(window_count > 0 && sector >= window_first && sector < window_first + window_count) {
+            uint32_t n = window_first + window_count - sector;
+            if(n > count) n = count;
+            memcpy(buffer, window_data() + (sector - window_first) * SECTOR_SIZE, n * SECTOR_SIZE);
+            stats.hits += n;
+            buffer += n * SECTOR_SIZE;
+            sector += n;
+            count -= n;
+            next_sector = sector;
+            continue;
+        }
+
+        if(sector < metadata_limit) {
+            int rc = read_metadata(buffer, sector);
+            if(rc != 0) return rc;
+            buffer += SECTOR_SIZE;
+            sector++;
+            count--;
+            continue;
+        }
+
+        // a small read that continues the last one is a file being streamed, fetch ahead of it
+        if(sector == next_sector && count < window && sector + window <= sectors) {
+            int rc = disk->disk_read(window_data(), sector, window);
+            if(rc != 0) {
+                window_count = 0;
+                return rc;
+            }
+            window_first = sector;
+            window_count = window;
+            stats.readaheads++;
+            continue;
+        }
+
+        // random and large reads go straight to the card
+        stats.misses += count;
+        next_sector = sector + count;
+        return disk->disk_read(buffer, sector, count);
+    }
+    return 0;
+}
+
+int SectorCache::write(const char *buffer, uint32_t sector, uint32_t count)
+{
+    int rc = disk->disk_write(buffer, sector, count);
+    if(data == nullptr) return rc;
+    if(rc != 0) {
+        // what made it to the card is unknown
+        invalidate();
+        return rc;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t s = sector + i;
+        const char *src = buffer + i * SECTOR_SIZE;
+        if(s < metadata_limit) {
+            for (uint8_t j = 0; j < slots; ++j) {
+                if(tags[j].sector == s) memcpy(slot_data(j), src, SECTOR_SIZE);
+            }
+        }
+        if(window_count > 0 && s >= window_first && s < window_first + window_count) {
+            memcpy(window_data() + (s - window_first) * SECTOR_SIZE, src, SECTOR_SIZE);
+        }
+    }
+    return 0;
+}
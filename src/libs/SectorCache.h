@@ -0,0 +1,65 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SECTORCACHE_H
+#define SECTORCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class MSD_Disk;
+
+// Read cache between FatFs and the card
+// Sectors below the metadata limit (FAT and FAT16 root directory) are kept in a small LRU,
+// reads that continue where the last data read ended fetch a window of sectors in one multi-block read.
+// Writes go through to the disk and update any cached copy, so nothing is ever dirty
+class SectorCache {
+    public:
+        SectorCache(MSD_Disk *disk);
+
+        // allocates slots + window sectors, returns false if there is no memory, the cache then passes everything through
+        bool init(uint8_t slots, uint8_t window);
+        bool is_enabled() const { return data != nullptr; }
+
+        int read(char *buffer, uint32_t sector, uint32_t count);
+        int write(const char *buffer, uint32_t sector, uint32_t count);
+
+        void set_metadata_limit(uint32_t sector) { metadata_limit = sector; }
+        void set_sectors(uint32_t n) { sectors = n; }
+        void invalidate();
+
+        struct {
+            uint32_t hits;
+            uint32_t misses;
+            uint32_t readaheads;
+        } stats;
+
+    private:
+        static const size_t SECTOR_SIZE = 512;
+
+        char *slot_data(uint8_t i) const { return data + (i * SECTOR_SIZE); }
+        char *window_data() const { return data + (slots * SECTOR_SIZE); }
+        int read_metadata(char *buffer, uint32_t sector);
+
+        MSD_Disk *disk;
+        char *data;           // slots sectors of LRU followed by window sectors of read-ahead
+        struct tag_t {
+            uint32_t sector;
+            uint32_t used;
+        } *tags;
+        uint8_t slots;
+        uint8_t window;
+
+        uint32_t metadata_limit;
+        uint32_t sectors;      // size of the disk, read-ahead never goes past it
+        uint32_t window_first;
+        uint32_t window_count;
+        uint32_t next_sector;  // where the last data read ended
+        uint32_t use_count;
+};
+
+#endif
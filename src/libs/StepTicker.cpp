@@ -15,6 +15,7 @@
 #include "StreamOutputPool.h"
 #include "Block.h"
 #include "Conveyor.h"
+#include "Pin.h"
 
 #include "system_LPC17xx.h" // mbed.h lib
 #include <math.h>
@@ -153,6 +154,9 @@ void StepTicker::step_tick (void)
         return;
     }
 
+    // sample the probe before stepping so the latched position is where the edge was seen
+    if(probe_pin != nullptr) check_probe();
+
     bool still_moving= false;
     // foreach motor, if it is active see if time to issue a step to that motor
     for (uint8_t m = 0; m < num_motors; m++) {
@@ -235,6 +239,7 @@ void StepTicker::step_tick (void)
         }else{
             current_block= nullptr;
             running= false;
+            THECONVEYOR->starved();
         }
 
         // all moves finished
@@ -278,6 +283,80 @@ bool StepTicker::start_next_block()
 }
 
 
+// only called from the step tick ISR
+void StepTicker::check_probe()
+{
+    bool state= probe_pin->get() != probe_invert;
+    if(state == probe_state) return;
+    probe_state= state;
+
+    if(digitize_queue != nullptr) {
+        // every contact and release is queued, points are dropped if the consumer falls behind
+        probe_latch_t l;
+        for (uint8_t m = 0; m < num_motors; m++) l.steps[m]= motor[m]->get_current_step();
+        l.triggered= state;
+        digitize_queue->put(l);
+        return;
+    }
+
+    if(!state || probe_latched) return;
+
+    for (uint8_t m = 0; m < num_motors; m++) probe_latch.steps[m]= motor[m]->get_current_step();
+    probe_latch.triggered= true;
+    probe_latched= true;
+
+    if(probe_stop) {
+        // no debounce wanted so stop right here rather than waiting for the next probe poll
+        for (uint8_t m = 0; m < num_motors; m++) motor[m]->stop_moving();
+    }
+}
+
+// latch the actuator positions the first time pin triggers, if stop is set the motors are stopped in the ISR as well
+void StepTicker::arm_probe_latch(Pin *pin, bool invert, bool stop)
+{
+    disarm_probe_latch();
+    start_probe_latch(pin, invert, stop);
+}
+
+void StepTicker::start_probe_latch(Pin *pin, bool invert, bool stop)
+{
+    probe_invert= invert;
+    probe_stop= stop;
+    probe_state= (pin->get() != invert);
+    probe_latched= false;
+    probe_pin= pin;
+}
+
+void StepTicker::disarm_probe_latch()
+{
+    probe_pin= nullptr;
+    if(digitize_queue != nullptr) {
+        // ISR no longer looks at the queue once probe_pin is cleared
+        delete digitize_queue;
+        digitize_queue= nullptr;
+    }
+}
+
+bool StepTicker::get_probe_latch(probe_latch_t &latch) const
+{
+    if(!probe_latched) return false;
+    latch= probe_latch;
+    return true;
+}
+
+void StepTicker::arm_digitize(Pin *pin, bool invert)
+{
+    disarm_probe_latch();
+    digitize_queue= new TSRingBuffer<probe_latch_t, 32>();
+    start_probe_latch(pin, invert, false);
+}
+
+bool StepTicker::get_digitize_point(probe_latch_t &latch)
+{
+    if(digitize_queue == nullptr) return false;
+    return digitize_queue->get(latch);
+}
+
 // returns index of the stepper motor in the array and bitset
 int StepTicker::register_motor(StepperMotor* m)
 {
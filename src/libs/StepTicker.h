@@ -20,6 +20,7 @@
 
 class StepperMotor;
 class Block;
+class Pin;
 
 // handle 2.62 Fixed point
 #define STEPTICKER_FPSCALE (1LL<<62)
@@ -43,12 +44,30 @@ class StepTicker{
         // whatever setup the block should register this to know when it is done
         std::function<void()> finished_fnc{nullptr};
 
+        // actuator positions captured in the step ISR when the probe pin changed state
+        struct probe_latch_t {
+            int32_t steps[k_max_actuators];
+            bool triggered;
+        };
+
+        // the probe pin is sampled every step tick so the position is exact at any feed rate
+        void arm_probe_latch(Pin *pin, bool invert, bool stop);
+        void disarm_probe_latch();
+        void reset_probe_latch() { probe_latched= false; }
+        bool get_probe_latch(probe_latch_t &latch) const;
+
+        // digitize queues every change of the probe pin instead of latching the first trigger
+        void arm_digitize(Pin *pin, bool invert);
+        bool get_digitize_point(probe_latch_t &latch);
+
         static StepTicker *getInstance() { return instance; }
 
     private:
         static StepTicker *instance;
 
         bool start_next_block();
+        void check_probe();
+        void start_probe_latch(Pin *pin, bool invert, bool stop);
 
         float frequency;
         uint32_t period;
@@ -58,6 +77,15 @@ class StepTicker{
         Block *current_block;
         uint32_t current_tick{0};
 
+        Pin * volatile probe_pin{nullptr};
+        probe_latch_t probe_latch;
+        TSRingBuffer<probe_latch_t, 32> *digitize_queue{nullptr};
+        // not in the bitfield below as these are written from outside the step ISR
+        volatile bool probe_latched{false};
+        bool probe_invert{false};
+        bool probe_stop{false};
+        bool probe_state{false};
+
         struct {
             volatile bool running:1;
             uint8_t num_motors:4;
@@ -30,8 +30,17 @@ class StreamOutput {
         virtual int puts(const char* buf, int size = 0) = 0;
         virtual bool ready() { return true; };
         virtual int type() {return 0; }; // 0: serial, 1: wifi
+        virtual void flush() {} // blocks until buffered output has been sent
+        virtual int rx_free() { return -1; } // free space in the receive buffer for character counting hosts, -1 if not buffered
+
+        // set by $B1 when the client wants binary status frames instead of the ? string
+        void set_binary_status(bool f) { binary_status = f; }
+        bool is_binary_status() const { return binary_status; }
 
         static NullStreamOutput NullStream;
+
+    private:
+        bool binary_status{false};
 };
 
 class NullStreamOutput : public StreamOutput {
@@ -34,6 +34,14 @@ public:
         return r;
     }
 
+    void flush()
+    {
+        for(set<StreamOutput*>::iterator i = this->streams.begin(); i != this->streams.end(); i++)
+        {
+            (*i)->flush();
+        }
+    }
+
     void append_stream(StreamOutput* stream)
     {
         this->streams.insert(stream);
@@ -7,6 +7,7 @@
 
 #include "libs/Kernel.h"
 #include "libs/utils.h"
+#include "libs/StreamOutputPool.h"
 #include "system_LPC17xx.h"
 #include "LPC17xx.h"
 #include "utils.h"
@@ -183,6 +184,9 @@ bool file_exists( const string file_name )
 // Prepares and executes a watchdog reset for dfu or reboot
 void system_reset( bool dfu )
 {
+    // let any queued console output and eeprom writes get out first
+    THEKERNEL->streams->flush();
+    THEKERNEL->flush_eeprom_data();
     if(dfu) {
         LPC_WDT->WDCLKSEL = 0x1;                // Set CLK src to PCLK
         uint32_t clk = SystemCoreClock / 16;    // WD has a fixed /4 prescaler, PCLK default is /4
@@ -274,6 +278,14 @@ std::string change_to_lz_path( std::string origin )
 	return "/sd/gcodes/.lz/" + filename;
 }
 
+// Change from origin path to gcode metadata sidecar path
+std::string change_to_meta_path( std::string origin )
+{
+	unsigned found = origin.find("gcodes/");
+	string filename = origin.substr(found + 7);
+	// mirrors the subfolders of gcodes, like the md5 path, writers create them with check_and_make_path
+	return "/sd/gcodes/.meta/" + filename;
+}
 
 // Check the quicklz/md5 file path
 #define	FR_OK 0
@@ -35,6 +35,7 @@ void system_reset( bool dfu= false );
 std::string absolute_from_relative( std::string path );
 std::string change_to_md5_path( std::string origin );
 std::string change_to_lz_path( std::string origin );
+std::string change_to_meta_path( std::string origin );
 void check_and_make_path( std::string origin );
 
 int append_parameters(char *buf, std::vector<std::pair<char,float>> params, size_t bufsize);
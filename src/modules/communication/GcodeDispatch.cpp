@@ -29,6 +29,7 @@
 
 #define panel_display_message_checksum CHECKSUM("display_message")
 #define panel_checksum             CHECKSUM("panel")
+#define ok_reports_rx_free_checksum CHECKSUM("ok_reports_rx_free")
 
 // goes in Flash, list of Mxxx codes that are allowed when in Halted state
 static const int allowed_mcodes[]= {2,5,9,30,105,114,115,119,80,81,911,503,106,107}; // get temp, get pos, get endstops etc
@@ -42,6 +43,7 @@ static bool is_allowed_mcode(int m) {
 GcodeDispatch::GcodeDispatch()
 {
     uploading = false;
+    ok_reports_rx_free = false;
     modal_group_1= 0;
 }
 
@@ -49,6 +51,19 @@ GcodeDispatch::GcodeDispatch()
 void GcodeDispatch::on_module_loaded()
 {
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
+    this->ok_reports_rx_free = THEKERNEL->config->value(ok_reports_rx_free_checksum)->by_default(false)->as_bool();
+}
+
+// with ok_reports_rx_free a character counting host gets the receive buffer space back with every line it sent,
+// so every ok goes out through here, text is anything that follows the ok on the same line
+void GcodeDispatch::send_ok(StreamOutput *stream, const char *text)
+{
+    int rx = this->ok_reports_rx_free ? stream->rx_free() : -1;
+    if(rx >= 0) {
+        stream->printf("ok Bf:%d%s%s\r\n", rx, text == nullptr ? "" : " ", text == nullptr ? "" : text);
+    } else {
+        stream->printf("ok%s%s\r\n", text == nullptr ? "" : " ", text == nullptr ? "" : text);
+    }
 }
 
 // When a command is received, if it is a Gcode, dispatch it as an object via an event
@@ -59,7 +74,7 @@ void GcodeDispatch::on_console_line_received(void *line)
 
     // just reply ok to empty lines
     if(possible_command.empty()) {
-        new_message.stream->printf("ok\r\n");
+        send_ok(new_message.stream);
         return;
     }
 
@@ -173,7 +188,7 @@ try_again:
 							THEKERNEL->call_event(ON_HALT, (void *)1); // clears on_halt
 							new_message.stream->printf("WARNING: After HALT you should HOME as position is currently unknown\n");
 						}
-						new_message.stream->printf("ok\n");
+						send_ok(new_message.stream);
 						delete gcode;
 						return;
 
@@ -199,7 +214,7 @@ try_again:
 							// TODO it is really an error if the last is not G0 thru G3
 							if(modal_group_1 > 3) {
 								delete gcode;
-								new_message.stream->printf("ok - Invalid G53\r\n");
+								send_ok(new_message.stream, "- Invalid G53");
 								return;
 							}
 							// use last G0 or G1
@@ -213,7 +228,7 @@ try_again:
 							if(!gcode->has_g || gcode->g > 1) {
 								// not G0 or G1 so ignore it as it is invalid
 								delete gcode;
-								new_message.stream->printf("ok - Invalid G53\r\n");
+								send_ok(new_message.stream, "- Invalid G53");
 								return;
 							}
 						}
@@ -224,7 +239,7 @@ try_again:
 						// optimize G1 to send ok immediately (one per line) before it is planned
 						if(!sent_ok) {
 							sent_ok= true;
-							new_message.stream->printf("ok\n");
+							send_ok(new_message.stream);
 						}
 					}
 
@@ -244,10 +259,11 @@ try_again:
 							upload_fd = fopen(this->upload_filename.c_str(), "w");
 							if(upload_fd != NULL) {
 								this->uploading = true;
-								new_message.stream->printf("Writing to file: %s\r\nok\r\n", this->upload_filename.c_str());
+								new_message.stream->printf("Writing to file: %s\r\n", this->upload_filename.c_str());
 							} else {
-								new_message.stream->printf("open failed, File: %s.\r\nok\r\n", this->upload_filename.c_str());
+								new_message.stream->printf("open failed, File: %s.\r\n", this->upload_filename.c_str());
 							}
+							send_ok(new_message.stream);
 
 							// only save stuff from this stream
 							upload_stream= new_message.stream;
@@ -298,7 +314,8 @@ try_again:
 							if(THEKERNEL->is_bad_mcu()) {
 								new_message.stream->printf(", X-WARNING:deprecated_MCU");
 							}
-							new_message.stream->printf("\nok\n");
+							new_message.stream->printf("\n");
+							send_ok(new_message.stream);
 							return;
 						}
 
@@ -307,7 +324,7 @@ try_again:
 							string str= single_command.substr(4) + possible_command;
 							PublicData::set_value( panel_checksum, panel_display_message_checksum, &str );
 							delete gcode;
-							new_message.stream->printf("ok\r\n");
+							send_ok(new_message.stream);
 							return;
 						}
 
@@ -331,7 +348,7 @@ try_again:
 								}
 							}
 
-							new_message.stream->printf("ok\r\n");
+							send_ok(new_message.stream);
 							return;
 						}
 
@@ -351,7 +368,8 @@ try_again:
 							delete gcode->stream;
 							delete gcode;
 							__enable_irq();
-							new_message.stream->printf("Settings Stored to %s\r\nok\r\n", THEKERNEL->config_override_filename());
+							new_message.stream->printf("Settings Stored to %s\r\n", THEKERNEL->config_override_filename());
+							send_ok(new_message.stream);
 							continue;
 
 						case 501: // load config override
@@ -364,13 +382,14 @@ try_again:
 								SimpleShell::parse_command((gcode->m == 501) ? "load_command" : "save_command", arg, new_message.stream);
 							}
 							delete gcode;
-							new_message.stream->printf("ok\r\n");
+							send_ok(new_message.stream);
 							return;
 
 						case 502: // M502 deletes config-override so everything defaults to what is in config
 							remove(THEKERNEL->config_override_filename());
 							delete gcode;
-							new_message.stream->printf("config override file deleted %s, reboot needed\r\nok\r\n", THEKERNEL->config_override_filename());
+							new_message.stream->printf("config override file deleted %s, reboot needed\r\n", THEKERNEL->config_override_filename());
+							send_ok(new_message.stream);
 							continue;
 
 						case 503: { // M503 display live settings and indicates if there is an override file
@@ -419,17 +438,17 @@ try_again:
 						new_message.stream->printf("\r\n");
 
 					if(!gcode->txt_after_ok.empty()) {
-						new_message.stream->printf("ok %s\r\n", gcode->txt_after_ok.c_str());
+						send_ok(new_message.stream, gcode->txt_after_ok.c_str());
 						gcode->txt_after_ok.clear();
 
 					} else {
 						if(THEKERNEL->is_ok_per_line() || THEKERNEL->is_grbl_mode()) {
 							// only send ok once per line if this is a multi g code line send ok on the last one
 							if(possible_command.empty())
-								new_message.stream->printf("ok\r\n");
+								send_ok(new_message.stream);
 						} else {
 							// maybe should do the above for all hosts?
-							new_message.stream->printf("ok\r\n");
+							send_ok(new_message.stream);
 						}
 					}
 				}
@@ -445,13 +464,14 @@ try_again:
 					uploading = false;
 					upload_filename.clear();
 					upload_stream= nullptr;
-					new_message.stream->printf("Done saving file.\r\nok\r\n");
+					new_message.stream->printf("Done saving file.\r\n");
+					send_ok(new_message.stream);
 					continue;
 				}
 
 				if(upload_fd == NULL) {
 					// error detected writing to file so discard everything until it stops
-					new_message.stream->printf("ok\r\n");
+					send_ok(new_message.stream);
 					continue;
 				}
 
@@ -464,14 +484,14 @@ try_again:
 					continue;
 
 				} else {
-					 new_message.stream->printf("ok\r\n");
+					send_ok(new_message.stream);
 					//printf("uploading file write ok\n");
 				}
 			}
 		}
     } else if ( first_char == ';' || first_char == '(' || first_char == '\n' || first_char == '\r' ) {
         // Ignore comments and blank lines
-        new_message.stream->printf("ok\n");
+        send_ok(new_message.stream);
 
     } else if( (n=possible_command.find_first_of("XYZAF")) == 0 || (first_char == ' ' && n != string::npos) ) {
         // handle pycam syntax, use last modal group 1 command and resubmit if an X Y Z or F is found on its own line
@@ -489,7 +509,8 @@ try_again:
 
     } else {
         // an uppercase non command word on its own (except XYZAF) just returns ok, we could add an error but no hosts expect that.
-        new_message.stream->printf("ok - ignore: [%s]\n", possible_command.c_str());
+        string text= "- ignore: [" + possible_command + "]";
+        send_ok(new_message.stream, text.c_str());
     }
 }
 
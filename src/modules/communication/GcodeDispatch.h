@@ -24,11 +24,14 @@ public:
 
     uint8_t get_modal_command() const { return modal_group_1<4 ? modal_group_1 : 0; }
 private:
+    void send_ok(StreamOutput *stream, const char *text= nullptr);
+
     std::string upload_filename;
     FILE *upload_fd;
     StreamOutput* upload_stream{nullptr};
     uint8_t modal_group_1;
     struct {
         bool uploading: 1;
+        bool ok_reports_rx_free: 1;
     };
 };
@@ -19,6 +19,12 @@ using std::string;
 #include "ATCHandlerPublicAccess.h"
 #include "PublicDataRequest.h"
 #include "PublicData.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+
+#define uart_checksum                   CHECKSUM("uart")
+#define rx_buffer_size_checksum         CHECKSUM("rx_buffer_size")
 
 
 // Serial reading module
@@ -26,21 +32,30 @@ using std::string;
 // The command dispatcher will then ask other modules if they can do something with it
 SerialConsole::SerialConsole( PinName rx_pin, PinName tx_pin, int baud_rate ){
     this->serial = new mbed::Serial( rx_pin, tx_pin );
+    this->tx_busy = false;
     this->serial->baud(baud_rate);
 }
 
+SerialConsole::~SerialConsole()
+{
+    // the TX interrupt must not outlive us
+    flush();
+    this->serial->attach(nullptr, mbed::Serial::TxIrq);
+}
+
 // Called when the module has just been loaded
 void SerialConsole::on_module_loaded() {
     // We want to be called every time a new char is received
     query_flag = false;
     halt_flag = false;
     diagnose_flag = false;
+    this->buffer.init(THEKERNEL->config->value(uart_checksum, rx_buffer_size_checksum)->by_default(256)->as_number());
 	this->attach_irq(true);
 
     // We only call the command dispatcher in the main loop, nowhere else
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_IDLE);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, atc_handler_checksum);
 
     // Add to the pack of streams kernel can call to, for example for broadcasting
     THEKERNEL->streams->append_stream(this);
@@ -95,7 +110,7 @@ void SerialConsole::on_serial_char_received() {
         }
 		// convert CR to NL (for host OSs that don't send NL)
 		if ( received == '\r' ) { received = '\n'; }
-		this->buffer.push_back(received);
+		this->buffer.put(received);
     }
 }
 
@@ -105,12 +120,18 @@ void SerialConsole::on_idle(void * argument)
 
     if (query_flag ) {
         query_flag = false;
-        puts(THEKERNEL->get_query_string().c_str(), 0);
+        if (is_binary_status()) {
+            const uint8_t *frame;
+            size_t n = THEKERNEL->get_status_frame(&frame);
+            puts(reinterpret_cast<const char *>(frame), n);
+        } else {
+            THEKERNEL->send_query_string(this);
+        }
     }
 
     if (diagnose_flag) {
     	diagnose_flag = false;
-    	puts(THEKERNEL->get_diagnose_string().c_str(), 0);
+    	puts(THEKERNEL->get_diagnose_string(), 0);
     }
 
     if (halt_flag) {
@@ -127,24 +148,12 @@ void SerialConsole::on_idle(void * argument)
 
 // Actual event calling must happen in the main loop because if it happens in the interrupt we will loose data
 void SerialConsole::on_main_loop(void * argument){
-    if ( this->has_char('\n') ){
-        string received;
-        received.reserve(20);
-        while(1){
-           char c;
-           this->buffer.pop_front(c);
-           if( c == '\n' ){
-                struct SerialMessage message;
-                message.message = received;
-                message.stream = this;
-                message.line = 0;
-                THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
-                // this->puts(received.c_str());
-                return;
-            }else{
-                received += c;
-            }
-        }
+    if ( this->buffer.has_line() ){
+        struct SerialMessage message;
+        this->buffer.get_line(message.message);
+        message.stream = this;
+        message.line = 0;
+        THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
     }
 }
 
@@ -164,9 +173,59 @@ int SerialConsole::gets(char** buf, int size)
 	return 1;
 }
 
+// queues the char for the TX interrupt, only waits when the buffer is full
 int SerialConsole::_putc(int c)
 {
-    return this->serial->putc(c);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    while (this->tx_buffer.next_block_index(this->tx_buffer.head) == this->tx_buffer.tail) {
+        if (primask != 0 || __get_IPSR() != 0) {
+            // the TX interrupt may not get to run from here, so send one ourselves
+            char o;
+            this->tx_buffer.pop_front(o);
+            this->serial->putc(o);
+        } else {
+            __enable_irq();
+            __disable_irq();
+        }
+    }
+    this->tx_buffer.push_back(c);
+    if (!this->tx_busy) {
+        this->tx_busy = true;
+        this->serial->attach(this, &SerialConsole::on_serial_tx_ready, mbed::Serial::TxIrq);
+        // THRE only interrupts on the transition to empty, so start it off if the UART is already idle
+        on_serial_tx_ready();
+    }
+    if (primask == 0) __enable_irq();
+    return c;
+}
+
+// Called on Serial::TxIrq interrupt, the transmit holding register is empty
+void SerialConsole::on_serial_tx_ready()
+{
+    while (this->tx_buffer.tail != this->tx_buffer.head && this->serial->writeable()) {
+        char c;
+        this->tx_buffer.pop_front(c);
+        this->serial->putc(c);
+    }
+    if (this->tx_buffer.tail == this->tx_buffer.head) {
+        this->serial->attach(nullptr, mbed::Serial::TxIrq);
+        this->tx_busy = false;
+    }
+}
+
+// waits until everything queued has been handed to the UART, for before a reset and the like
+void SerialConsole::flush()
+{
+    while (this->tx_busy) {
+        uint32_t primask = __get_PRIMASK();
+        if (primask != 0 || __get_IPSR() != 0) {
+            __disable_irq();
+            on_serial_tx_ready();
+            if (primask == 0) __enable_irq();
+        }
+    }
+    while (!this->serial->writeable()) ;
 }
 
 int SerialConsole::_getc()
@@ -179,14 +238,3 @@ bool SerialConsole::ready()
     return this->serial->readable();
 }
 
-// Does the queue have a given char ?
-bool SerialConsole::has_char(char letter){
-    int index = this->buffer.tail;
-    while( index != this->buffer.head ){
-        if( this->buffer.buffer[index] == letter ){
-            return true;
-        }
-        index = this->buffer.next_block_index(index);
-    }
-    return false;
-}
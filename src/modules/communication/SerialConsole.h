@@ -15,6 +15,7 @@
 #include <string>
 using std::string;
 #include "libs/RingBuffer.h"
+#include "libs/LineBuffer.h"
 #include "libs/StreamOutput.h"
 
 
@@ -23,13 +24,14 @@ using std::string;
 class SerialConsole : public Module, public StreamOutput {
     public:
         SerialConsole( PinName rx_pin, PinName tx_pin, int baud_rate );
+        ~SerialConsole();
 
         void on_module_loaded();
         void on_serial_char_received();
+        void on_serial_tx_ready();
         void on_main_loop(void * argument);
         void on_idle(void * argument);
         void on_set_public_data(void *argument);
-        bool has_char(char letter);
         void attach_irq(bool enable_irq);
 
         int _putc(int c);
@@ -37,11 +39,15 @@ class SerialConsole : public Module, public StreamOutput {
         int puts(const char*, int size = 0);
         int gets(char** buf, int size = 0);
         bool ready();
+        void flush();
+        int rx_free() { return this->buffer.free(); }
         char getc_result;
 
         //string receive_buffer;                 // Received chars are stored here until a newline character is received
         //vector<std::string> received_lines;    // Received lines are stored here until they are requested
-        RingBuffer<char,256> buffer;             // Receive buffer
+        LineBuffer buffer;                       // Receive buffer, uart.rx_buffer_size chars
+        RingBuffer<char,1024> tx_buffer;         // Transmit buffer, drained by the TX interrupt
+        volatile bool tx_busy;                   // TX interrupt is attached and draining tx_buffer
         mbed::Serial* serial;
         struct {
           bool query_flag:1;
@@ -29,6 +29,7 @@ using std::string;
 #define max_voltage_checksum			CHECKSUM("max_voltage")
 #define baud_rate_setting_checksum 		CHECKSUM("baud_rate")
 #define uart_checksum              		CHECKSUM("uart")
+#define rx_buffer_size_checksum			CHECKSUM("rx_buffer_size")
 
 
 // Wireless probe serial reading module
@@ -45,6 +46,7 @@ void SerialConsole2::on_module_loaded() {
     this->serial->baud(THEKERNEL->config->value(uart_checksum, baud_rate_setting_checksum)->by_default(DEFAULT_SERIAL_BAUD_RATE)->as_number());
 
     // We want to be called every time a new char is received
+    this->buffer.init(THEKERNEL->config->value(wp_checksum, rx_buffer_size_checksum)->by_default(256)->as_number());
     this->serial->attach(this, &SerialConsole2::on_serial_char_received, mbed::Serial::RxIrq);
 
     this->min_voltage = THEKERNEL->config->value(wp_checksum, min_voltage_checksum)->by_default(3.6F)->as_number();
@@ -52,9 +54,11 @@ void SerialConsole2::on_module_loaded() {
 
     // We only call the command dispatcher in the main loop, nowhere else
     this->register_for_event(ON_MAIN_LOOP);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
-    this->register_for_event(ON_GCODE_RECEIVED);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, atc_handler_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, atc_handler_checksum);
+    for (uint16_t m : {470, 471, 472, 881, 882}) {
+        this->register_for_gcode('M', m);
+    }
 }
 
 
@@ -64,57 +68,47 @@ void SerialConsole2::on_serial_char_received() {
         char received = this->serial->getc();
         // convert CR to NL (for host OSs that don't send NL)
         if ( received == '\r' ) { received = '\n'; }
-        this->buffer.push_back(received);
+        this->buffer.put(received);
     }
 }
 
 // Actual event calling must happen in the main loop because if it happens in the interrupt we will loose data
 void SerialConsole2::on_main_loop(void * argument) {
-    if ( this->has_char('\n') ) {
-        string received;
-        received.reserve(20);
-        while (1) {
-           char c;
-           this->buffer.pop_front(c);
-           if ( c == '\n' ) {
-        	   // THEKERNEL->streams->printf("WP received: [%s]\n", received.c_str());
-        	   if (received[0] == 'V') {
-            	   // get wireless probe voltage
-            	   Gcode gc(received, &StreamOutput::NullStream);
-            	   if (gc.get_value('V') <= 4.2) {
-                	   this->wp_voltage = gc.get_value('V');
-                	   // compare voltage value and switch probe charger
-                	   if (this->wp_voltage <= this->min_voltage) {
-                		   struct pad_switch pad;
-                           bool ok = PublicData::get_value(switch_checksum, probecharger_checksum, 0, &pad);
-                           if (!ok || !pad.state) {
-                        	   if (!THEKERNEL->is_uploading())
-                        		   THEKERNEL->streams->printf("WP voltage: [%1.2fV], start charging\n", this->wp_voltage);
-                    		   bool b = true;
-                    		   PublicData::set_value( switch_checksum, probecharger_checksum, state_checksum, &b );
-                           }
-                	   } else if (this->wp_voltage >= this->max_voltage) {
-                		   struct pad_switch pad;
-                           bool ok = PublicData::get_value(switch_checksum, probecharger_checksum, 0, &pad);
-                           if (!ok || pad.state) {
-                        	   if (!THEKERNEL->is_uploading())
-                        		   THEKERNEL->streams->printf("WP voltage: [%1.2fV], end charging\n", this->wp_voltage);
-                    		   bool b = false;
-                    		   PublicData::set_value( switch_checksum, probecharger_checksum, state_checksum, &b );
-                           }
-                	   }
-            	   }
-        	   } else if (received[0] == 'A' && received.length() > 2) {
-        		   // get wireless probe address
-        		   uint16_t probe_addr = ((uint16_t)received[2] << 8) | received[1];
-        		   THEKERNEL->streams->printf("WP power: [%1.2fv], addr: [%0d]\n", this->wp_voltage, probe_addr);
-        	   } else if (received[0] == 'P' && received.length() > 1) {
-        		   THEKERNEL->streams->printf("WP PAIR %s!\n", received[1] ? "SUCCESS" : "TIMEOUT");
-        	   }
-               return;
-            } else {
-                received += c;
+    string received;
+    if ( this->buffer.get_line(received) ) {
+        // THEKERNEL->streams->printf("WP received: [%s]\n", received.c_str());
+        if (received[0] == 'V') {
+            // get wireless probe voltage
+            Gcode gc(received, &StreamOutput::NullStream);
+            if (gc.get_value('V') <= 4.2) {
+                this->wp_voltage = gc.get_value('V');
+                // compare voltage value and switch probe charger
+                if (this->wp_voltage <= this->min_voltage) {
+                    struct pad_switch pad;
+                    bool ok = PublicData::get_value(switch_checksum, probecharger_checksum, 0, &pad);
+                    if (!ok || !pad.state) {
+                        if (!THEKERNEL->is_uploading())
+                            THEKERNEL->streams->printf("WP voltage: [%1.2fV], start charging\n", this->wp_voltage);
+                        bool b = true;
+                        PublicData::set_value( switch_checksum, probecharger_checksum, state_checksum, &b );
+                    }
+                } else if (this->wp_voltage >= this->max_voltage) {
+                    struct pad_switch pad;
+                    bool ok = PublicData::get_value(switch_checksum, probecharger_checksum, 0, &pad);
+                    if (!ok || pad.state) {
+                        if (!THEKERNEL->is_uploading())
+                            THEKERNEL->streams->printf("WP voltage: [%1.2fV], end charging\n", this->wp_voltage);
+                        bool b = false;
+                        PublicData::set_value( switch_checksum, probecharger_checksum, state_checksum, &b );
+                    }
+                }
             }
+        } else if (received[0] == 'A' && received.length() > 2) {
+            // get wireless probe address
+            uint16_t probe_addr = ((uint16_t)received[2] << 8) | received[1];
+            THEKERNEL->streams->printf("WP power: [%1.2fv], addr: [%0d]\n", this->wp_voltage, probe_addr);
+        } else if (received[0] == 'P' && received.length() > 1) {
+            THEKERNEL->streams->printf("WP PAIR %s!\n", received[1] ? "SUCCESS" : "TIMEOUT");
         }
     }
 }
@@ -146,17 +140,6 @@ int SerialConsole2::_getc()
     return this->serial->getc();
 }
 
-// Does the queue have a given char ?
-bool SerialConsole2::has_char(char letter){
-    int index = this->buffer.tail;
-    while( index != this->buffer.head ){
-        if( this->buffer.buffer[index] == letter ){
-            return true;
-        }
-        index = this->buffer.next_block_index(index);
-    }
-    return false;
-}
 
 void SerialConsole2::on_get_public_data(void *argument) {
     PublicDataRequest* pdr = static_cast<PublicDataRequest*>(argument);
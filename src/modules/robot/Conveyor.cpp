@@ -29,6 +29,7 @@
 
 #define planner_queue_size_checksum CHECKSUM("planner_queue_size")
 #define queue_delay_time_ms_checksum CHECKSUM("queue_delay_time_ms")
+#define queue_status_report_checksum CHECKSUM("planner_queue_status_report")
 
 /*
  * The conveyor holds the queue of blocks, takes care of creating them, and starting the executing chain of blocks
@@ -63,6 +64,9 @@ Conveyor::Conveyor()
     running = false;
     allow_fetch = false;
     flush= false;
+    job_active = false;
+    telemetry_in_status = false;
+    reset_telemetry();
 }
 
 void Conveyor::on_module_loaded()
@@ -74,6 +78,7 @@ void Conveyor::on_module_loaded()
     //THEKERNEL->step_ticker->finished_fnc = std::bind( &Conveyor::all_moves_finished, this);
     queue_size = THEKERNEL->config->value(planner_queue_size_checksum)->by_default(32)->as_number();
     queue_delay_time_ms = THEKERNEL->config->value(queue_delay_time_ms_checksum)->by_default(100)->as_number();
+    telemetry_in_status = THEKERNEL->config->value(queue_status_report_checksum)->by_default(false)->as_bool();
 }
 
 // we allocate the queue here after config is completed so we do not run out of memory during config
@@ -97,6 +102,8 @@ void Conveyor::on_idle(void*)
         check_queue();
     }
 
+    if(job_active) sample_telemetry();
+
     // we can garbage collect the block queue here
     if (queue.tail_i != queue.isr_tail_i) {
         if (queue.is_empty()) {
@@ -105,6 +112,10 @@ void Conveyor::on_idle(void*)
             // Cleanly delete block
             Block* block = queue.tail_ref();
             //block->debug();
+            if(!flush && block->is_ticking) {
+                telemetry.blocks++;
+                telemetry.block_ticks += block->total_move_ticks;
+            }
             block->clear();
             queue.consume_tail();
         }
@@ -251,6 +262,70 @@ void Conveyor::flush_queue()
     flush= false;
 }
 
+// number of blocks queued, including the one being executed
+unsigned int Conveyor::queue_depth() const
+{
+    return (queue.head_i + queue.length - queue.isr_tail_i) % queue.length;
+}
+
+// blocks that can still be queued
+unsigned int Conveyor::queue_free() const
+{
+    return queue.length - 1 - queue_depth();
+}
+
+void Conveyor::sample_telemetry()
+{
+    uint32_t now = us_ticker_read();
+    uint32_t ms = (now - telemetry.last_sample_us) / 1000;
+    if(ms == 0) return;
+    telemetry.last_sample_us += ms * 1000;
+    if(ms > 100) ms = 100; // we were blocked somewhere, do not let one sample dominate
+
+    unsigned int depth = queue_depth();
+    telemetry.depth_hist[depth * 8 / queue.length] += ms;
+    telemetry.sampled_ms += ms;
+    if(queue.is_full()) {
+        telemetry.full_ms += ms;
+    } else if(depth == 0) {
+        telemetry.empty_ms += ms;
+    }
+}
+
+void Conveyor::reset_telemetry()
+{
+    telemetry.starved = 0;
+    for (auto& h : telemetry.depth_hist) h = 0;
+    telemetry.full_ms = 0;
+    telemetry.empty_ms = 0;
+    telemetry.sampled_ms = 0;
+    telemetry.blocks = 0;
+    telemetry.block_ticks = 0;
+    telemetry.last_sample_us = us_ticker_read();
+}
+
+void Conveyor::print_telemetry(StreamOutput *stream)
+{
+    uint32_t sampled = telemetry.sampled_ms > 0 ? telemetry.sampled_ms : 1;
+    stream->printf("queue size: %u, depth: %u, starved: %lu\n", queue.length, queue_depth(), telemetry.starved);
+    stream->printf("sampled %lums, full %lu%%, empty %lu%%\n", telemetry.sampled_ms, telemetry.full_ms * 100 / sampled, telemetry.empty_ms * 100 / sampled);
+    stream->printf("depth histogram:");
+    for (int i = 0; i < 8; ++i) {
+        stream->printf(" %u-%u:%lu%%", i * queue.length / 8, (i + 1) * queue.length / 8 - 1, telemetry.depth_hist[i] * 100 / sampled);
+    }
+    stream->printf("\n");
+    uint32_t avg_us = telemetry.blocks > 0 ? (uint32_t)(telemetry.block_ticks * 1000000 / THEKERNEL->base_stepping_frequency / telemetry.blocks) : 0;
+    stream->printf("blocks: %lu, average duration: %luus\n", telemetry.blocks, avg_us);
+}
+
+// |Q:depth,starved count,percent of time full,percent of time empty
+size_t Conveyor::format_telemetry(char *buf, size_t size)
+{
+    uint32_t sampled = telemetry.sampled_ms > 0 ? telemetry.sampled_ms : 1;
+    size_t n = snprintf(buf, size, "|Q:%u,%lu,%lu,%lu", queue_depth(), telemetry.starved, telemetry.full_ms * 100 / sampled, telemetry.empty_ms * 100 / sampled);
+    return n > size ? size : n;
+}
+
 // Debug function
 void Conveyor::dump_queue()
 {
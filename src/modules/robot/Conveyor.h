@@ -10,7 +10,10 @@
 #include "libs/Module.h"
 #include "BlockQueue.h"
 
+#include <stddef.h>
+
 class Block;
+class StreamOutput;
 
 class Conveyor : public Module
 {
@@ -36,11 +39,23 @@ public:
     float get_current_feedrate() const { return current_feedrate; }
     void force_queue() { check_queue(true); }
 
+    // planner telemetry
+    void starved() { if(running && job_active && !flush) telemetry.starved++; } // called from step ticker ISR when it runs out of blocks
+    void set_job_active(bool f) { job_active = f; }
+    bool is_telemetry_in_status() const { return telemetry_in_status; }
+    unsigned int queue_depth() const;
+    unsigned int queue_free() const;
+    size_t get_queue_size() const { return queue_size; }
+    void reset_telemetry();
+    void print_telemetry(StreamOutput *stream);
+    size_t format_telemetry(char *buf, size_t size);
+
     friend class Planner; // for queue
 
 private:
     void check_queue(bool force= false);
     void queue_head_block(void);
+    void sample_telemetry();
 
     using  Queue_t= BlockQueue;
     Queue_t queue;  // Queue of Blocks
@@ -49,10 +64,24 @@ private:
     size_t queue_size;
     float current_feedrate{0}; // actual nominal feedrate that current block is running at in mm/sec
 
+    // queue depth is sampled every ms while a job plays, histogram buckets are eighths of the queue
+    struct {
+        volatile uint32_t starved;
+        uint32_t depth_hist[8];
+        uint32_t full_ms;
+        uint32_t empty_ms;
+        uint32_t sampled_ms;
+        uint32_t blocks;
+        uint64_t block_ticks;
+        uint32_t last_sample_us;
+    } telemetry;
+
     struct {
         volatile bool running:1;
         volatile bool allow_fetch:1;
         bool flush:1;
+        volatile bool job_active:1;
+        bool telemetry_in_status:1;
     };
 
 };
@@ -1250,6 +1250,38 @@ void Robot::process_move(Gcode *gcode, enum MOTION_MODE_T motion_mode)
     }
 }
 
+// a G0/G1 for modules that run their own move sequences, the target is found and the line segmented and compensated
+// the same as for a gcode move, but without a Gcode and without touching the modal feed rates
+// param is in mm, nan for an axis that does not move
+bool Robot::move_to(const float param[3], MOVE_COORDS coords, float rate_mm_s)
+{
+    if(rate_mm_s <= 0.0F) return false;
+
+    float offset[3]{0, 0, 0};
+    if(coords == MOVE_WCS) {
+        offset[X_AXIS]= std::get<X_AXIS>(wcs_offsets[current_wcs]) - std::get<X_AXIS>(g92_offset) + std::get<X_AXIS>(tool_offset);
+        offset[Y_AXIS]= std::get<Y_AXIS>(wcs_offsets[current_wcs]) - std::get<Y_AXIS>(g92_offset) + std::get<Y_AXIS>(tool_offset);
+        offset[Z_AXIS]= std::get<Z_AXIS>(wcs_offsets[current_wcs]) - std::get<Z_AXIS>(g92_offset) + std::get<Z_AXIS>(tool_offset);
+    } else if(coords == MOVE_REL) {
+        memcpy(offset, machine_position, sizeof(offset));
+    }
+
+    float target[n_motors];
+    memcpy(target, machine_position, n_motors*sizeof(float));
+    for(int i= X_AXIS; i <= Z_AXIS; ++i) {
+        if(!isnan(param[i])) target[i]= ROUND_NEAR_HALF(param[i] + offset[i]);
+    }
+
+    bool moved= append_line(target, rate_mm_s, 0, !isnan(param[X_AXIS]) || !isnan(param[Y_AXIS]));
+
+    // needed to act as start of next arc command
+    memcpy(arc_milestone, target, sizeof(arc_milestone));
+    if(moved) {
+        memcpy(machine_position, target, n_motors * sizeof(float));
+    }
+    return moved;
+}
+
 // reset the machine position for all axis. Used for homing.
 // after homing we supply the cartesian coordinates that the head is at when homed,
 // however for Z this is the compensated machine position (if enabled)
@@ -1643,12 +1675,18 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
         return false;
     }
 
+    return append_line(target, rate_mm_s, gcode->line, gcode->has_letter('X') || gcode->has_letter('Y'));
+}
+
+// segments the line as needed and queues it, xy_move is false for a move that only gives Z
+bool Robot::append_line(const float target[], float rate_mm_s, unsigned int line, bool xy_move)
+{
     // Find out the distance for this move in XYZ in MCS
     float millimeters_of_travel = sqrtf(powf( target[X_AXIS] - machine_position[X_AXIS], 2 ) +  powf( target[Y_AXIS] - machine_position[Y_AXIS], 2 ) +  powf( target[Z_AXIS] - machine_position[Z_AXIS], 2 ));
 
     if(millimeters_of_travel < 0.00001F) {
         // we have no movement in XYZ, probably E only extrude or retract
-        return this->append_milestone(target, rate_mm_s, gcode->line);
+        return this->append_milestone(target, rate_mm_s, line);
     }
 
     /*
@@ -1670,7 +1708,7 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
     // The latter is more efficient and avoids splitting fast long lines into very small segments, like initial z move to 0, it is what Johanns Marlin delta port does
     uint16_t segments;
 
-    if(this->disable_segmentation || (!segment_z_moves && !gcode->has_letter('X') && !gcode->has_letter('Y'))) {
+    if(this->disable_segmentation || (!segment_z_moves && !xy_move)) {
         segments= 1;
 
     } else if(this->delta_segments_per_second > 1.0F) {
@@ -1710,13 +1748,13 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
 
             // Append the end of this segment to the queue
             // this can block waiting for free block queue or if in feed hold
-            bool b= this->append_milestone(segment_end, rate_mm_s, gcode->line);
+            bool b= this->append_milestone(segment_end, rate_mm_s, line);
             moved= moved || b;
         }
     }
 
     // Append the end of this full move to the queue
-    if(this->append_milestone(target, rate_mm_s, gcode->line)) moved= true;
+    if(this->append_milestone(target, rate_mm_s, line)) moved= true;
 
     this->next_command_is_MCS = false; // always reset this
 
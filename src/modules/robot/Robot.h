@@ -43,6 +43,8 @@ class Robot : public Module {
         void loadToolOffset(const float offset[N_PRIMARY_AXIS]);
         void saveToolOffset(const float offset[N_PRIMARY_AXIS], const float cur_tool_mz);
         float get_feed_rate() const;
+        float get_seek_rate() const { return seek_rate; }
+        float get_programmed_feed_rate() const { return feed_rate; } // G1 feed even while G0 is the modal command
         float get_s_value() const { return s_value; }
         void set_s_value(float s) { s_value= s; }
         float get_max_delta() const { return max_delta; }
@@ -62,6 +64,9 @@ class Robot : public Module {
         std::tuple<float, float, float, uint8_t> get_last_probe_position() const { return last_probe_position; }
         void set_last_probe_position(std::tuple<float, float, float, uint8_t> p) { last_probe_position = p; }
         bool delta_move(const float delta[], float rate_mm_s, uint8_t naxis);
+        enum MOVE_COORDS { MOVE_MCS, MOVE_WCS, MOVE_REL }; // as G53, G90 and G91
+        bool move_to(const float param[3], MOVE_COORDS coords, float rate_mm_s);
+        bool is_homed(uint8_t i) const;
         uint8_t register_motor(StepperMotor*);
         uint8_t get_number_registered_motors() const {return n_motors; }
         uint8_t get_current_motion_mode() const {return current_motion_mode; }
@@ -113,10 +118,10 @@ class Robot : public Module {
         void load_config();
         bool append_milestone(const float target[], float rate_mm_s, unsigned int line);
         bool append_line( Gcode* gcode, const float target[], float rate_mm_s, float delta_e);
+        bool append_line(const float target[], float rate_mm_s, unsigned int line, bool xy_move);
         bool append_arc( Gcode* gcode, const float target[], const float offset[], float radius, bool is_clockwise );
         bool compute_arc(Gcode* gcode, const float offset[], const float target[], enum MOTION_MODE_T motion_mode);
         void process_move(Gcode *gcode, enum MOTION_MODE_T);
-        bool is_homed(uint8_t i) const;
 
         float theta(float x, float y);
         void select_plane(uint8_t axis_0, uint8_t axis_1, uint8_t axis_2);
@@ -86,6 +86,10 @@
 #define clearance_y_checksum		CHECKSUM("clearance_y")
 #define clearance_z_checksum		CHECKSUM("clearance_z")
 
+#define tlo_cache_enable_checksum	CHECKSUM("tlo_cache_enable")
+#define tlo_cache_max_age_checksum	CHECKSUM("tlo_cache_max_age_s")
+#define tlo_spot_check_checksum		CHECKSUM("tlo_spot_check_mm")
+
 ATCHandler::ATCHandler()
 {
     atc_status = NONE;
@@ -105,6 +109,67 @@ ATCHandler::ATCHandler()
     goto_position = -1;
     position_x = 8888;
     position_y = 8888;
+    uptime_secs = 0;
+}
+
+ATCHandler::atc_cmd ATCHandler::atc_cmd::move(TYPE type, uint16_t g) {
+	atc_cmd cmd;
+	cmd.type = type;
+	cmd.letter = 'G';
+	cmd.num = g;
+	cmd.subcode = 0;
+	cmd.nargs = 0;
+	cmd.spot_check = false;
+	return cmd;
+}
+
+ATCHandler::atc_cmd ATCHandler::atc_cmd::code(char letter, uint16_t num, uint8_t subcode) {
+	atc_cmd cmd;
+	cmd.type = CODE;
+	cmd.letter = letter;
+	cmd.num = num;
+	cmd.subcode = subcode;
+	cmd.nargs = 0;
+	cmd.spot_check = false;
+	return cmd;
+}
+
+ATCHandler::atc_cmd& ATCHandler::atc_cmd::arg(char letter, float value) {
+	if (nargs < sizeof(arg_letters)) {
+		arg_letters[nargs] = letter;
+		arg_values[nargs] = value;
+		nargs++;
+	}
+	return *this;
+}
+
+ATCHandler::atc_cmd& ATCHandler::atc_cmd::in_spot_check() {
+	spot_check = true;
+	return *this;
+}
+
+float ATCHandler::atc_cmd::get_arg(char letter) const {
+	for (int i = 0; i < nargs; i ++) {
+		if (arg_letters[i] == letter) return arg_values[i];
+	}
+	return NAN;
+}
+
+// gcode text of the command, used for the echo and to dispatch codes
+void ATCHandler::atc_cmd::format(char *buf, size_t size) const {
+	static const char *prefix[] = {"G53 ", "G90 ", "G91 ", ""};
+	int n = snprintf(buf, size, "%s%c%u", prefix[type], letter, num);
+	if (subcode > 0 && n < (int)size) {
+		n += snprintf(&buf[n], size - n, ".%u", subcode);
+	}
+	for (int i = 0; i < nargs && n < (int)size; i ++) {
+		float v = arg_values[i];
+		if (v == (int)v) {
+			n += snprintf(&buf[n], size - n, " %c%d", arg_letters[i], (int)v);
+		} else {
+			n += snprintf(&buf[n], size - n, " %c%.3f", arg_letters[i], v);
+		}
+	}
 }
 
 void ATCHandler::clear_script_queue(){
@@ -114,308 +179,290 @@ void ATCHandler::clear_script_queue(){
 }
 
 void ATCHandler::fill_drop_scripts(int old_tool) {
-	char buff[100];
 	struct atc_tool *current_tool = &atc_tools[old_tool];
 	// set atc status
-	this->script_queue.push("M497.1");
+	this->script_queue.push(atc_cmd::code('M', 497, 1));
     // lift z axis to atc start position
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(this->clearance_z));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(this->clearance_z)));
     // move x and y to active tool position
-	snprintf(buff, sizeof(buff), "G53 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(current_tool->mx_mm), THEROBOT->from_millimeters(current_tool->my_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('X', THEROBOT->from_millimeters(current_tool->mx_mm)).arg('Y', THEROBOT->from_millimeters(current_tool->my_mm)));
 	// move around to see if tool rack is empty
-	this->script_queue.push("M492.2");
+	this->script_queue.push(atc_cmd::code('M', 492, 2));
     // move x and y to reseted tool position
-	snprintf(buff, sizeof(buff), "G53 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(current_tool->mx_mm), THEROBOT->from_millimeters(current_tool->my_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('X', THEROBOT->from_millimeters(current_tool->mx_mm)).arg('Y', THEROBOT->from_millimeters(current_tool->my_mm)));
     // drop z axis to z position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G1 Z%.3f F%.3f", THEROBOT->from_millimeters(current_tool->mz_mm + safe_z_offset_mm), THEROBOT->from_millimeters(fast_z_rate));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 1).arg('Z', THEROBOT->from_millimeters(current_tool->mz_mm + safe_z_offset_mm)).arg('F', THEROBOT->from_millimeters(fast_z_rate)));
     // drop z axis with slow speed
-	snprintf(buff, sizeof(buff), "G53 G1 Z%.3f F%.3f", THEROBOT->from_millimeters(current_tool->mz_mm), THEROBOT->from_millimeters(slow_z_rate));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 1).arg('Z', THEROBOT->from_millimeters(current_tool->mz_mm)).arg('F', THEROBOT->from_millimeters(slow_z_rate)));
 	// loose tool
-	this->script_queue.push("M490.2");
+	this->script_queue.push(atc_cmd::code('M', 490, 2));
 	// lift z to safe position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(this->safe_z_empty_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(this->safe_z_empty_mm)));
 	// set new tool to -1
-	this->script_queue.push("M493.2 T-1");
+	this->script_queue.push(atc_cmd::code('M', 493, 2).arg('T', -1));
 	// move around to see if tool is dropped, halt if not
-	this->script_queue.push("M492.1");
+	this->script_queue.push(atc_cmd::code('M', 492, 1));
 }
 
 void ATCHandler::fill_pick_scripts(int new_tool, bool clear_z) {
-	char buff[100];
 	struct atc_tool *current_tool = &atc_tools[new_tool];
 	// set atc status
-	this->script_queue.push("M497.2");
+	this->script_queue.push(atc_cmd::code('M', 497, 2));
 	// lift z to safe position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(clear_z ? this->clearance_z : this->safe_z_empty_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(clear_z ? this->clearance_z : this->safe_z_empty_mm)));
 	// move x and y to new tool position
-	snprintf(buff, sizeof(buff), "G53 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(current_tool->mx_mm), THEROBOT->from_millimeters(current_tool->my_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('X', THEROBOT->from_millimeters(current_tool->mx_mm)).arg('Y', THEROBOT->from_millimeters(current_tool->my_mm)));
 	// move around to see if tool rack is filled
-	this->script_queue.push("M492.1");
+	this->script_queue.push(atc_cmd::code('M', 492, 1));
 	// loose tool
-	this->script_queue.push("M490.2");
+	this->script_queue.push(atc_cmd::code('M', 490, 2));
 	// move x and y to reseted tool position
-	snprintf(buff, sizeof(buff), "G53 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(current_tool->mx_mm), THEROBOT->from_millimeters(current_tool->my_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('X', THEROBOT->from_millimeters(current_tool->mx_mm)).arg('Y', THEROBOT->from_millimeters(current_tool->my_mm)));
     // drop z axis to z position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G1 Z%.3f F%.3f", THEROBOT->from_millimeters(current_tool->mz_mm + safe_z_offset_mm), THEROBOT->from_millimeters(fast_z_rate));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 1).arg('Z', THEROBOT->from_millimeters(current_tool->mz_mm + safe_z_offset_mm)).arg('F', THEROBOT->from_millimeters(fast_z_rate)));
     // drop z axis with slow speed
-	snprintf(buff, sizeof(buff), "G53 G1 Z%.3f F%.3f", THEROBOT->from_millimeters(current_tool->mz_mm), THEROBOT->from_millimeters(slow_z_rate));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 1).arg('Z', THEROBOT->from_millimeters(current_tool->mz_mm)).arg('F', THEROBOT->from_millimeters(slow_z_rate)));
 	// clamp tool
-	this->script_queue.push("M490.1");
+	this->script_queue.push(atc_cmd::code('M', 490, 1));
 	// lift z to safe position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(this->safe_z_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(this->safe_z_mm)));
 	// move around to see if tool rack is empty, halt if not
-	this->script_queue.push("M492.2");
+	this->script_queue.push(atc_cmd::code('M', 492, 2));
 	// set new tool
-	snprintf(buff, sizeof(buff), "M493.2 T%d", new_tool);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('M', 493, 2).arg('T', new_tool));
 
 }
 
 void ATCHandler::fill_cali_scripts(bool is_probe, bool clear_z) {
-	char buff[100];
 	// set atc status
-	this->script_queue.push("M497.3");
+	this->script_queue.push(atc_cmd::code('M', 497, 3));
 	// clamp tool if in laser mode
 	if (THEKERNEL->get_laser_mode()) {
-		this->script_queue.push("M490.1");
+		this->script_queue.push(atc_cmd::code('M', 490, 1));
 	}
 	// lift z to safe position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(clear_z ? this->clearance_z : this->safe_z_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(clear_z ? this->clearance_z : this->safe_z_mm)));
 	// move x and y to calibrate position
-	snprintf(buff, sizeof(buff), "G53 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(probe_mx_mm), THEROBOT->from_millimeters(probe_my_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('X', THEROBOT->from_millimeters(probe_mx_mm)).arg('Y', THEROBOT->from_millimeters(probe_my_mm)));
 	// do calibrate with fast speed
-	snprintf(buff, sizeof(buff), "G38.6 Z%.3f F%.3f", probe_mz_mm, probe_fast_rate);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 38, 6).arg('Z', probe_mz_mm).arg('F', probe_fast_rate));
 	// lift a bit
-	snprintf(buff, sizeof(buff), "G91 G0 Z%.3f", THEROBOT->from_millimeters(probe_retract_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('Z', THEROBOT->from_millimeters(probe_retract_mm)));
 	// do calibrate with slow speed
-	snprintf(buff, sizeof(buff), "G38.6 Z%.3f F%.3f", -1 - probe_retract_mm, probe_slow_rate);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 38, 6).arg('Z', -1 - probe_retract_mm).arg('F', probe_slow_rate));
 	// save new tool offset
-	this->script_queue.push("M493.1");
+	this->script_queue.push(atc_cmd::code('M', 493, 1));
 	// lift z to safe position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(this->safe_z_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(this->safe_z_mm)));
 
 	// check if wireless probe is will be triggered
 	if (is_probe) {
-		this->script_queue.push("M492.3");
+		this->script_queue.push(atc_cmd::code('M', 492, 3));
 	}
 }
 
-void ATCHandler::fill_margin_scripts(float x_pos, float y_pos, float x_pos_max, float y_pos_max) {
-	char buff[100];
+// calibrate a tool just picked from the rack, reusing the length cached for that slot if it is still trusted
+void ATCHandler::fill_tool_cali_scripts(int new_tool, bool clear_z) {
+	bool is_probe = (new_tool == 0);
+	if (tlo_cache_enable && new_tool >= 0 && new_tool < (int)tlo_cache.size() && tlo_cache[new_tool].valid) {
+		// the wireless probe is always touched off as that is also how we know it is alive
+		if (!is_probe && uptime_secs - tlo_cache[new_tool].measured_secs <= tlo_cache_max_age_s) {
+			this->script_queue.push(atc_cmd::code('M', 493, 3).arg('T', new_tool));
+			return;
+		}
+		if (tlo_spot_check_mm > 0) {
+			this->fill_spot_check_scripts(new_tool, clear_z);
+			return;
+		}
+	}
+	this->fill_cali_scripts(is_probe, clear_z);
+}
 
+// short calibration starting just above the cached tool length, M493.5 falls back to the full cycle if it is off
+void ATCHandler::fill_spot_check_scripts(int new_tool, bool clear_z) {
+	float cached_mz = tlo_cache[new_tool].mz_mm;
 	// set atc status
-	this->script_queue.push("M497.4");
+	this->script_queue.push(atc_cmd::code('M', 497, 3));
+	// lift z to safe position with fast speed
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(clear_z ? this->clearance_z : this->safe_z_mm)));
+	// move x and y to calibrate position
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('X', THEROBOT->from_millimeters(probe_mx_mm)).arg('Y', THEROBOT->from_millimeters(probe_my_mm)));
+	// rapid down to just above where the tool touched last time
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(cached_mz + 2 * probe_retract_mm)));
+	// do calibrate with fast speed, no alarm if not found
+	this->script_queue.push(atc_cmd::code('G', 38, 7).arg('Z', -4 * probe_retract_mm).arg('F', probe_fast_rate));
+	// lift a bit
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('Z', THEROBOT->from_millimeters(probe_retract_mm)));
+	// do calibrate with slow speed, no alarm if not found
+	this->script_queue.push(atc_cmd::code('G', 38, 7).arg('Z', -1 - probe_retract_mm).arg('F', probe_slow_rate));
+	// save new tool offset if within tolerance of the cached one, otherwise do the full calibration
+	this->script_queue.push(atc_cmd::code('M', 493, 5));
+	// what follows is part of the spot check and is replaced by the full calibration if it fails
+	// lift z to safe position with fast speed
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(this->safe_z_mm)).in_spot_check());
+
+	// check if wireless probe is will be triggered
+	if (new_tool == 0) {
+		this->script_queue.push(atc_cmd::code('M', 492, 3).in_spot_check());
+	}
+}
+
+void ATCHandler::fill_margin_scripts(float x_pos, float y_pos, float x_pos_max, float y_pos_max) {
+	// set atc status
+	this->script_queue.push(atc_cmd::code('M', 497, 4));
 
 	// open probe laser
-	this->script_queue.push("M494.1");
+	this->script_queue.push(atc_cmd::code('M', 494, 1));
 
 	// lift z to safe position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(this->clearance_z));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(this->clearance_z)));
 
 	// goto margin start position
-	snprintf(buff, sizeof(buff), "G90 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(x_pos), THEROBOT->from_millimeters(y_pos));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_WCS, 0).arg('X', THEROBOT->from_millimeters(x_pos)).arg('Y', THEROBOT->from_millimeters(y_pos)));
 
 	// goto margin top left corner
-	snprintf(buff, sizeof(buff), "G90 G1 X%.3f Y%.3f F%.3f", THEROBOT->from_millimeters(x_pos), THEROBOT->from_millimeters(y_pos_max), THEROBOT->from_millimeters(this->margin_rate));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_WCS, 1).arg('X', THEROBOT->from_millimeters(x_pos)).arg('Y', THEROBOT->from_millimeters(y_pos_max)).arg('F', THEROBOT->from_millimeters(this->margin_rate)));
 
 	// goto margin top right corner
-	snprintf(buff, sizeof(buff), "G90 G1 X%.3f Y%.3f F%.3f", THEROBOT->from_millimeters(x_pos_max), THEROBOT->from_millimeters(y_pos_max), THEROBOT->from_millimeters(this->margin_rate));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_WCS, 1).arg('X', THEROBOT->from_millimeters(x_pos_max)).arg('Y', THEROBOT->from_millimeters(y_pos_max)).arg('F', THEROBOT->from_millimeters(this->margin_rate)));
 
 	// goto margin bottom right corner
-	snprintf(buff, sizeof(buff), "G90 G1 X%.3f Y%.3f F%.3f", THEROBOT->from_millimeters(x_pos_max), THEROBOT->from_millimeters(y_pos), THEROBOT->from_millimeters(this->margin_rate));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_WCS, 1).arg('X', THEROBOT->from_millimeters(x_pos_max)).arg('Y', THEROBOT->from_millimeters(y_pos)).arg('F', THEROBOT->from_millimeters(this->margin_rate)));
 
 	// goto margin start position
-	snprintf(buff, sizeof(buff), "G90 G1 X%.3f Y%.3f F%.3f", THEROBOT->from_millimeters(x_pos), THEROBOT->from_millimeters(y_pos), THEROBOT->from_millimeters(this->margin_rate));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_WCS, 1).arg('X', THEROBOT->from_millimeters(x_pos)).arg('Y', THEROBOT->from_millimeters(y_pos)).arg('F', THEROBOT->from_millimeters(this->margin_rate)));
 
 	// close probe laser
-	this->script_queue.push("M494.2");
+	this->script_queue.push(atc_cmd::code('M', 494, 2));
 
 }
 
 void ATCHandler::fill_goto_origin_scripts(float x_pos, float y_pos) {
-	char buff[100];
-
 	// lift z to clearance position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(this->clearance_z));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(this->clearance_z)));
 
 	// goto start position
-	snprintf(buff, sizeof(buff), "G90 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(x_pos), THEROBOT->from_millimeters(y_pos));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_WCS, 0).arg('X', THEROBOT->from_millimeters(x_pos)).arg('Y', THEROBOT->from_millimeters(y_pos)));
 
 }
 
 void ATCHandler::fill_zprobe_scripts(float x_pos, float y_pos, float x_offset, float y_offset) {
-	char buff[100];
-
 	// set atc status
-	this->script_queue.push("M497.5");
+	this->script_queue.push(atc_cmd::code('M', 497, 5));
 
 	// lift z to safe position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(this->clearance_z));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(this->clearance_z)));
 
 	// goto z probe position
-	snprintf(buff, sizeof(buff), "G90 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(x_pos + x_offset), THEROBOT->from_millimeters(y_pos + y_offset));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_WCS, 0).arg('X', THEROBOT->from_millimeters(x_pos + x_offset)).arg('Y', THEROBOT->from_millimeters(y_pos + y_offset)));
 
 	// do probe with fast speed
-	snprintf(buff, sizeof(buff), "G38.2 Z%.3f F%.3f", probe_mz_mm, probe_fast_rate);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 38, 2).arg('Z', probe_mz_mm).arg('F', probe_fast_rate));
 
 	// lift a bit
-	snprintf(buff, sizeof(buff), "G91 G0 Z%.3f", THEROBOT->from_millimeters(probe_retract_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('Z', THEROBOT->from_millimeters(probe_retract_mm)));
 
 	// do calibrate with slow speed
-	snprintf(buff, sizeof(buff), "G38.2 Z%.3f F%.3f", -1 - probe_retract_mm, probe_slow_rate);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 38, 2).arg('Z', -1 - probe_retract_mm).arg('F', probe_slow_rate));
 
 	// set z working coordinate
-	snprintf(buff, sizeof(buff), "G10 L20 P0 Z%.3f", THEROBOT->from_millimeters(probe_height_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 10).arg('L', 20).arg('P', 0).arg('Z', THEROBOT->from_millimeters(probe_height_mm)));
 
 	// retract z a bit
-	snprintf(buff, sizeof(buff), "G91 G0 Z%.3f", THEROBOT->from_millimeters(probe_retract_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('Z', THEROBOT->from_millimeters(probe_retract_mm)));
 }
 
 void ATCHandler::fill_zprobe_abs_scripts() {
-	char buff[100];
-
 	// set atc status
-	this->script_queue.push("M497.5");
+	this->script_queue.push(atc_cmd::code('M', 497, 5));
 
 	// lift z to safe position with fast speed
-	snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(clearance_z));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(clearance_z)));
 
 	// goto z probe position
-	snprintf(buff, sizeof(buff), "G53 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(anchor1_x + rotation_offset_x - 3), THEROBOT->from_millimeters(anchor1_y + rotation_offset_y));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('X', THEROBOT->from_millimeters(anchor1_x + rotation_offset_x - 3)).arg('Y', THEROBOT->from_millimeters(anchor1_y + rotation_offset_y)));
 
 	// do probe with fast speed
-	snprintf(buff, sizeof(buff), "G38.2 Z%.3f F%.3f", probe_mz_mm, probe_fast_rate);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 38, 2).arg('Z', probe_mz_mm).arg('F', probe_fast_rate));
 
 	// lift a bit
-	snprintf(buff, sizeof(buff), "G91 G0 Z%.3f", THEROBOT->from_millimeters(probe_retract_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('Z', THEROBOT->from_millimeters(probe_retract_mm)));
 
 	// do calibrate with slow speed
-	snprintf(buff, sizeof(buff), "G38.2 Z%.3f F%.3f", -1 - probe_retract_mm, probe_slow_rate);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 38, 2).arg('Z', -1 - probe_retract_mm).arg('F', probe_slow_rate));
 
 	// set z working coordinate
-	snprintf(buff, sizeof(buff), "G10 L20 P0 Z%.3f", THEROBOT->from_millimeters(rotation_offset_z));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 10).arg('L', 20).arg('P', 0).arg('Z', THEROBOT->from_millimeters(rotation_offset_z)));
 
 	// retract z a bit
-	snprintf(buff, sizeof(buff), "G91 G0 Z%.3f", THEROBOT->from_millimeters(probe_retract_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('Z', THEROBOT->from_millimeters(probe_retract_mm)));
 }
 
 void ATCHandler::fill_xyzprobe_scripts(float tool_dia, float probe_height) {
-	char buff[100];
-
 	// set atc status
-	this->script_queue.push("M497.5");
+	this->script_queue.push(atc_cmd::code('M', 497, 5));
 
 	// do z probe with slow speed
-	snprintf(buff, sizeof(buff), "G38.2 Z%.3f F%.3f", probe_mz_mm, probe_slow_rate);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 38, 2).arg('Z', probe_mz_mm).arg('F', probe_slow_rate));
 
 	// set Z origin
-	snprintf(buff, sizeof(buff), "G10 L20 P0 Z%.3f", THEROBOT->from_millimeters(probe_height));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 10).arg('L', 20).arg('P', 0).arg('Z', THEROBOT->from_millimeters(probe_height)));
 
 	// lift a bit
-	snprintf(buff, sizeof(buff), "G91 G0 Z%.3f", THEROBOT->from_millimeters(probe_retract_mm));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('Z', THEROBOT->from_millimeters(probe_retract_mm)));
 
 	// do x probe with slow speed
-	snprintf(buff, sizeof(buff), "G38.2 X%.3f F%.3f", -35.0, probe_slow_rate);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 38, 2).arg('X', -35.0).arg('F', probe_slow_rate));
 
 	// set x origin
-	snprintf(buff, sizeof(buff), "G10 L20 P0 X%.3f", THEROBOT->from_millimeters(tool_dia / 2));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 10).arg('L', 20).arg('P', 0).arg('X', THEROBOT->from_millimeters(tool_dia / 2)));
 
 	// move right a little bit
-	snprintf(buff, sizeof(buff), "G91 G0 X%.3f", THEROBOT->from_millimeters(5.0));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('X', THEROBOT->from_millimeters(5.0)));
 
 	// do y probe with slow speed
-	snprintf(buff, sizeof(buff), "G38.2 Y%.3f F%.3f", -35.0, probe_slow_rate);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 38, 2).arg('Y', -35.0).arg('F', probe_slow_rate));
 
 	// set y origin
-	snprintf(buff, sizeof(buff), "G10 L20 P0 Y%.3f", THEROBOT->from_millimeters(tool_dia / 2));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 10).arg('L', 20).arg('P', 0).arg('Y', THEROBOT->from_millimeters(tool_dia / 2)));
 
 	// move forward a little bit
-	snprintf(buff, sizeof(buff), "G91 G0 Y%.3f", THEROBOT->from_millimeters(5.0));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('Y', THEROBOT->from_millimeters(5.0)));
 
 	// retract z to be above probe
-	snprintf(buff, sizeof(buff), "G91 G0 Z%.3f", THEROBOT->from_millimeters(15.0));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('Z', THEROBOT->from_millimeters(15.0)));
 
 	// move to XY zero
-	snprintf(buff, sizeof(buff), "G91 G0 X%.3f Y%0.3f", THEROBOT->from_millimeters(-5 - tool_dia / 2), THEROBOT->from_millimeters(-5 - tool_dia / 2));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_REL, 0).arg('X', THEROBOT->from_millimeters(-5 - tool_dia / 2)).arg('Y', THEROBOT->from_millimeters(-5 - tool_dia / 2)));
 
 }
 
 void ATCHandler::fill_autolevel_scripts(float x_pos, float y_pos,
 		float x_size, float y_size, int x_grids, int y_grids, float height)
 {
-	char buff[100];
-
 	// set atc status
-	this->script_queue.push("M497.6");
+	this->script_queue.push(atc_cmd::code('M', 497, 6));
 
 	// goto x and y path origin
-	snprintf(buff, sizeof(buff), "G90 G0 X%.3f Y%.3f", THEROBOT->from_millimeters(x_pos), THEROBOT->from_millimeters(y_pos));
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_WCS, 0).arg('X', THEROBOT->from_millimeters(x_pos)).arg('Y', THEROBOT->from_millimeters(y_pos)));
 
 	// do auto leveling
-	snprintf(buff, sizeof(buff), "G32R1X0Y0A%.3fB%.3fI%dJ%dH%.3f", x_size, y_size, x_grids, y_grids, height);
-	this->script_queue.push(buff);
+	this->script_queue.push(atc_cmd::code('G', 32).arg('R', 1).arg('X', 0).arg('Y', 0).arg('A', x_size).arg('B', y_size).arg('I', x_grids).arg('J', y_grids).arg('H', height));
 }
 
 void ATCHandler::on_module_loaded()
 {
 
-    this->register_for_event(ON_GCODE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_gcode('M', 6);
+    for (uint16_t m = 490; m <= 499; m ++) {
+    	this->register_for_gcode('M', m);
+    }
+    this->register_for_gcode('G', 28);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, atc_handler_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, atc_handler_checksum);
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_HALT);
+    this->register_for_event(ON_SECOND_TICK);
 
     this->on_config_reload(this);
 
@@ -491,6 +538,12 @@ void ATCHandler::on_config_reload(void *argument)
 	this->clearance_x = THEKERNEL->config->value(coordinate_checksum, clearance_x_checksum)->by_default(-75  )->as_number();
 	this->clearance_y = THEKERNEL->config->value(coordinate_checksum, clearance_y_checksum)->by_default(-3  )->as_number();
 	this->clearance_z = THEKERNEL->config->value(coordinate_checksum, clearance_z_checksum)->by_default(-3  )->as_number();
+
+	this->tlo_cache_enable = THEKERNEL->config->value(atc_checksum, tlo_cache_enable_checksum)->by_default(false)->as_bool();
+	this->tlo_cache_max_age_s = THEKERNEL->config->value(atc_checksum, tlo_cache_max_age_checksum)->by_default(1800)->as_number();
+	this->tlo_spot_check_mm = THEKERNEL->config->value(atc_checksum, tlo_spot_check_checksum)->by_default(0.05F)->as_number();
+	tlo_cache.resize(atc_tools.size());
+	invalidate_tlo_cache(-1);
 }
 
 void ATCHandler::on_halt(void* argument)
@@ -501,9 +554,16 @@ void ATCHandler::on_halt(void* argument)
         this->set_inner_playing(false);
         THEKERNEL->set_atc_state(ATC_NONE);
         this->atc_home_info.clamp_status = UNHOMED;
+        // we can no longer be sure which tool is where
+        this->invalidate_tlo_cache(-1);
 	}
 }
 
+void ATCHandler::on_second_tick(void* argument)
+{
+	this->uptime_secs++;
+}
+
 // Called every millisecond in an ISR
 uint32_t ATCHandler::read_endstop(uint32_t dummy)
 {
@@ -704,6 +764,9 @@ void ATCHandler::loose_tool()
 
 	// First wait for the queue to be empty
     THECONVEYOR->wait_for_idle();
+    // and for a spindle stopped by M6 to have spun down
+    PublicData::set_value(pwm_spindle_control_checksum, wait_spindle_stopped_checksum, nullptr);
+    if(THEKERNEL->is_halted()) return;
 
 	float delta[ATC_AXIS + 1];
 	for (size_t i = 0; i <= ATC_AXIS; i++) delta[i] = 0;
@@ -724,16 +787,154 @@ void ATCHandler::set_tool_offset()
     uint8_t ps;
     std::tie(px, py, pz, ps) = THEROBOT->get_last_probe_position();
     if (ps == 1) {
-        cur_tool_mz = pz;
-        if (ref_tool_mz < 0) {
-        	tool_offset = cur_tool_mz - ref_tool_mz;
-        	const float offset[3] = {0.0, 0.0, tool_offset};
-        	THEROBOT->saveToolOffset(offset, cur_tool_mz);
+        apply_tool_mz(pz);
+        // remember the length for the next time this tool is picked
+        if (active_tool >= 0 && active_tool < (int)tlo_cache.size()) {
+        	tlo_cache[active_tool].mz_mm = pz;
+        	tlo_cache[active_tool].measured_secs = uptime_secs;
+        	tlo_cache[active_tool].valid = true;
         }
     }
 	
 }
 
+void ATCHandler::apply_tool_mz(float mz)
+{
+    cur_tool_mz = mz;
+    if (ref_tool_mz < 0) {
+    	tool_offset = cur_tool_mz - ref_tool_mz;
+    	const float offset[3] = {0.0, 0.0, tool_offset};
+    	THEROBOT->saveToolOffset(offset, cur_tool_mz);
+    }
+}
+
+// tool -1 invalidates every slot
+void ATCHandler::invalidate_tlo_cache(int tool)
+{
+	for (int i = 0; i < (int)tlo_cache.size(); i ++) {
+		if (tool < 0 || tool == i) {
+			tlo_cache[i].valid = false;
+		}
+	}
+}
+
+// called after the spot check probe, keep it if it agrees with the cache, otherwise replace the rest of the spot check with a full calibration
+void ATCHandler::check_tlo_spot()
+{
+    float px, py, pz;
+    uint8_t ps;
+    std::tie(px, py, pz, ps) = THEROBOT->get_last_probe_position();
+    if (ps == 1 && active_tool >= 0 && active_tool < (int)tlo_cache.size() && tlo_cache[active_tool].valid
+    		&& fabs(pz - tlo_cache[active_tool].mz_mm) <= tlo_spot_check_mm) {
+    	set_tool_offset();
+    	return;
+    }
+
+    THEKERNEL->streams->printf("Tool length spot check failed, doing full calibration\n");
+    invalidate_tlo_cache(active_tool);
+
+    // drop the rest of the spot check and put the full calibration in front of what follows
+    std::queue<atc_cmd> rest;
+    std::swap(rest, this->script_queue);
+    while (!rest.empty() && rest.front().spot_check) rest.pop();
+    this->fill_cali_scripts(active_tool == 0, false);
+    while (!rest.empty()) {
+    	this->script_queue.push(rest.front());
+    	rest.pop();
+    }
+}
+
+// M491.2, halts if the tool length measured now is off from tlo by more than tolerance, nan where H or P is not given
+void ATCHandler::check_tool_break(float tolerance, float tlo)
+{
+	THECONVEYOR->wait_for_idle();
+	if (isnan(tolerance)) {
+		tolerance = 0.1;
+	} else if (tolerance < 0.02) {
+		THEKERNEL->streams->printf("ERROR: Tool Break Check - tolerance set too small\n");
+		THEKERNEL->call_event(ON_HALT, nullptr);
+		THEKERNEL->set_halt_reason(CALIBRATE_FAIL);
+		return;
+	}
+	if (isnan(tlo)) {
+		tlo = 0;
+	} else if (tlo == 0) {
+		THEKERNEL->streams->printf("No previous TLO included, aborting\n");
+		return;
+	}
+	float new_tlo = THEKERNEL->eeprom_data->TLO;
+	THEKERNEL->streams->printf("Old: %.3f , new: %.3f\n",tlo,new_tlo);
+	//test for breakage
+	if (fabs(tlo - new_tlo) > tolerance) {
+		THEKERNEL->streams->printf("ERROR: Tool Break Check - check tool for breakage\n");
+		THEKERNEL->call_event(ON_HALT, nullptr);
+		THEKERNEL->set_halt_reason(CALIBRATE_FAIL);
+	}
+}
+
+// M492.x, halts if the tool or the wireless probe is not where it should be
+void ATCHandler::check_tool_detect(uint8_t subcode)
+{
+	if (subcode == 0 || subcode == 1) {
+		// check true
+		if (!laser_detect()) {
+	        THEKERNEL->call_event(ON_HALT, nullptr);
+	        THEKERNEL->set_halt_reason(ATC_NO_TOOL);
+	        THEKERNEL->streams->printf("ERROR: Tool confliction occured, please check tool rack!\n");
+		}
+	} else if (subcode == 2) {
+		// check false
+		if (laser_detect()) {
+	        THEKERNEL->call_event(ON_HALT, nullptr);
+	        THEKERNEL->set_halt_reason(ATC_HAS_TOOL);
+	        THEKERNEL->streams->printf("ERROR: Tool confliction occured, please check tool rack!\n");
+		}
+	} else if (subcode == 3) {
+		// check if the probe was triggered
+		if (!probe_detect()) {
+	        THEKERNEL->call_event(ON_HALT, nullptr);
+	        THEKERNEL->set_halt_reason(PROBE_INVALID);
+	        THEKERNEL->streams->printf("ERROR: Wireless probe dead or not set, please charge or set first!\n");
+		}
+	}
+}
+
+// M493.2
+void ATCHandler::set_active_tool(int tool)
+{
+	this->active_tool = tool;
+	// a tool set by hand may not be the one we measured for this slot
+	if (atc_status == NONE) {
+		invalidate_tlo_cache(this->active_tool);
+	}
+	// save current tool data to eeprom
+	if (THEKERNEL->eeprom_data->TOOL != this->active_tool) {
+	    THEKERNEL->eeprom_data->TOOL = this->active_tool;
+	    THEKERNEL->write_eeprom_data();
+	}
+}
+
+// M493.3, set tool offset from the cached tool length
+void ATCHandler::use_cached_tlo(int tool)
+{
+	if (tool >= 0 && tool < (int)tlo_cache.size() && tlo_cache[tool].valid) {
+		apply_tool_mz(tlo_cache[tool].mz_mm);
+		THEKERNEL->streams->printf("Tool length from cache: T%d %1.3f\n", tool, tlo_cache[tool].mz_mm);
+	} else {
+		THEKERNEL->call_event(ON_HALT, nullptr);
+		THEKERNEL->set_halt_reason(CALIBRATE_FAIL);
+		THEKERNEL->streams->printf("ERROR: No cached tool length for T%d!\n", tool);
+	}
+}
+
+// M497.x
+void ATCHandler::set_atc_state(uint8_t state)
+{
+    // wait for the queue to be empty
+    THECONVEYOR->wait_for_idle();
+	THEKERNEL->set_atc_state(state);
+}
+
 void ATCHandler::on_gcode_received(void *argument)
 {
     Gcode *gcode = static_cast<Gcode*>(argument);
@@ -752,7 +953,8 @@ void ATCHandler::on_gcode_received(void *argument)
     	    struct spindle_status ss;
     	    if (PublicData::get_value(pwm_spindle_control_checksum, get_spindle_status_checksum, &ss)) {
     	    	if (ss.state) {
-    	    		PublicData::set_value(pwm_spindle_control_checksum, turn_off_spindle_checksum, nullptr);
+    	    		// spins down while the scripts move to the rack, the tool is only released once it has stopped
+    	    		PublicData::set_value(pwm_spindle_control_checksum, stop_spindle_checksum, nullptr);
     	    	}
     	    }
 
@@ -787,7 +989,7 @@ void ATCHandler::on_gcode_received(void *argument)
                 		// just pick up tool
                 		atc_status = PICK;
                 		this->fill_pick_scripts(new_tool, true);
-                		this->fill_cali_scripts(new_tool == 0, false);
+                		this->fill_tool_cali_scripts(new_tool, false);
                 	} else if (new_tool < 0) {
                 		gcode->stream->printf("Start dropping current tool: T%d\r\n", this->active_tool);
                 		// just drop tool
@@ -802,7 +1004,7 @@ void ATCHandler::on_gcode_received(void *argument)
                 		atc_status = FULL;
                 	    this->fill_drop_scripts(active_tool);
                 	    this->fill_pick_scripts(new_tool, false);
-                	    this->fill_cali_scripts(new_tool == 0, false);
+                	    this->fill_tool_cali_scripts(new_tool, false);
                 	}
             	} else if (new_tool == -1  && THEKERNEL->get_laser_mode()) {
             		// calibrate
@@ -827,7 +1029,6 @@ void ATCHandler::on_gcode_received(void *argument)
 			}
 		} else if (gcode->m == 491) {
 			if (gcode->subcode == 1) {
-				char buff[100];
 				float tolerance = 0.1;
 				if (gcode->has_letter('H')) {
 		    		tolerance = gcode->get_value('H');
@@ -853,48 +1054,15 @@ void ATCHandler::on_gcode_received(void *argument)
 
 				THECONVEYOR->wait_for_idle();
 				// lift z to safe position with fast speed
-				snprintf(buff, sizeof(buff), "M5");
-				this->script_queue.push(buff);
-				snprintf(buff, sizeof(buff), "G53 G0 Z%.3f", THEROBOT->from_millimeters(this->safe_z_mm));
-				this->script_queue.push(buff);
-				snprintf(buff, sizeof(buff), "M491.2 H%.3f , P%.3f", tolerance, tlo);
-				this->script_queue.push(buff);
+				this->script_queue.push(atc_cmd::code('M', 5));
+				this->script_queue.push(atc_cmd::move(atc_cmd::MOVE_MCS, 0).arg('Z', THEROBOT->from_millimeters(this->safe_z_mm)));
+				this->script_queue.push(atc_cmd::code('M', 491, 2).arg('H', tolerance).arg('P', tlo));
 				
 				
 
 
 			}else if (gcode->subcode == 2){
-				float tlo = 0;
-				float tolerance = 0.1;
-				THECONVEYOR->wait_for_idle();
-				if (gcode->has_letter('H')) {
-		    		tolerance = gcode->get_value('H');
-					if (tolerance < 0.02) {
-						THEKERNEL->streams->printf("ERROR: Tool Break Check - tolerance set too small\n");
-						THEKERNEL->call_event(ON_HALT, nullptr);
-        				THEKERNEL->set_halt_reason(CALIBRATE_FAIL);
-						return;
-					}
-
-				}
-				if (gcode->has_letter('P')) {
-		    		tlo = gcode->get_value('P');
-					if (tlo == 0) {
-						THEKERNEL->streams->printf("No previous TLO included, aborting\n");
-						return;
-					}
-
-				}
-				float new_tlo = THEKERNEL->eeprom_data->TLO;
-				THEKERNEL->streams->printf("Old: %.3f , new: %.3f\n",tlo,new_tlo);
-				//test for breakage
-				if (fabs(tlo - new_tlo) > tolerance) {
-					THEKERNEL->streams->printf("ERROR: Tool Break Check - check tool for breakage\n");
-					THEKERNEL->call_event(ON_HALT, nullptr);
-					THEKERNEL->set_halt_reason(CALIBRATE_FAIL);
-					return;
-				}
-
+				check_tool_break(gcode->has_letter('H') ? gcode->get_value('H') : NAN, gcode->has_letter('P') ? gcode->get_value('P') : NAN);
 			} else {
 				// do calibrate
 				THEROBOT->push_state();
@@ -906,28 +1074,7 @@ void ATCHandler::on_gcode_received(void *argument)
 
 			}
 		} else if (gcode->m == 492) {
-			if (gcode->subcode == 0 || gcode->subcode == 1) {
-				// check true
-				if (!laser_detect()) {
-			        THEKERNEL->call_event(ON_HALT, nullptr);
-			        THEKERNEL->set_halt_reason(ATC_NO_TOOL);
-			        THEKERNEL->streams->printf("ERROR: Tool confliction occured, please check tool rack!\n");
-				}
-			} else if (gcode->subcode == 2) {
-				// check false
-				if (laser_detect()) {
-			        THEKERNEL->call_event(ON_HALT, nullptr);
-			        THEKERNEL->set_halt_reason(ATC_HAS_TOOL);
-			        THEKERNEL->streams->printf("ERROR: Tool confliction occured, please check tool rack!\n");
-				}
-			} else if (gcode->subcode == 3) {
-				// check if the probe was triggered
-				if (!probe_detect()) {
-			        THEKERNEL->call_event(ON_HALT, nullptr);
-			        THEKERNEL->set_halt_reason(PROBE_INVALID);
-			        THEKERNEL->streams->printf("ERROR: Wireless probe dead or not set, please charge or set first!\n");
-				}
-			}
+			check_tool_detect(gcode->subcode);
 		} else if (gcode->m == 493) {
 			if (gcode->subcode == 0 || gcode->subcode == 1) {
 				// set tooll offset
@@ -935,19 +1082,26 @@ void ATCHandler::on_gcode_received(void *argument)
 			} else if (gcode->subcode == 2) {
 				// set new tool
 				if (gcode->has_letter('T')) {
-		    		this->active_tool = gcode->get_value('T');
-		    		// save current tool data to eeprom
-		    		if (THEKERNEL->eeprom_data->TOOL != this->active_tool) {
-		        	    THEKERNEL->eeprom_data->TOOL = this->active_tool;
-		        	    THEKERNEL->write_eeprom_data();
-		    		}
-
+					set_active_tool(gcode->get_value('T'));
 				} else {
 					THEKERNEL->call_event(ON_HALT, nullptr);
 					THEKERNEL->set_halt_reason(ATC_NO_TOOL);
 					THEKERNEL->streams->printf("ERROR: No tool was set!\n");
 
 				}
+			} else if (gcode->subcode == 3) {
+				// set tool offset from the cached tool length
+				use_cached_tlo(gcode->has_letter('T') ? gcode->get_value('T') : active_tool);
+			} else if (gcode->subcode == 4) {
+				// forget cached tool length, for one slot or all of them
+				invalidate_tlo_cache(gcode->has_letter('T') ? gcode->get_value('T') : -1);
+			} else if (gcode->subcode == 5) {
+				// accept tool length spot check or do full calibration, only part of an atc sequence
+				if (atc_status == NONE) {
+					gcode->stream->printf("M493.5 is only used by the tool change scripts\r\n");
+				} else {
+					check_tlo_spot();
+				}
 			}
 		} else if (gcode->m == 494) {
 			// control probe laser
@@ -1038,7 +1192,7 @@ void ATCHandler::on_gcode_received(void *argument)
 			            		this->fill_drop_scripts(old_tool);
 			        		}
 		            		this->fill_pick_scripts(0, active_tool <= 0);
-		            		this->fill_cali_scripts(true, false);
+		            		this->fill_tool_cali_scripts(0, false);
 			            }
 			            if (margin) {
 			            	gcode->stream->printf("Auto scan margin\r\n");
@@ -1084,9 +1238,7 @@ void ATCHandler::on_gcode_received(void *argument)
 			}
 
 		} else if (gcode->m == 497) {
-		    // wait for the queue to be empty
-		    THECONVEYOR->wait_for_idle();
-			THEKERNEL->set_atc_state(gcode->subcode);
+			set_atc_state(gcode->subcode);
 		} else if (gcode->m == 498) {
 			if (gcode->subcode == 0 || gcode->subcode == 1) {
 				THEKERNEL->streams->printf("EEPRROM Data: TOOL:%d\n", THEKERNEL->eeprom_data->TOOL);
@@ -1106,6 +1258,14 @@ void ATCHandler::on_gcode_received(void *argument)
 				for (int i = 0; i <=  tool_number; i ++) {
 					THEKERNEL->streams->printf("tool%d -- mx:%1.1f my:%1.1f mz:%1.1f\n", atc_tools[i].num, atc_tools[i].mx_mm, atc_tools[i].my_mm, atc_tools[i].mz_mm);
 				}
+			} else if (gcode->subcode == 3) {
+				for (int i = 0; i < (int)tlo_cache.size(); i ++) {
+					if (tlo_cache[i].valid) {
+						THEKERNEL->streams->printf("tool%d -- cached mz:%1.3f age:%lus\n", i, tlo_cache[i].mz_mm, uptime_secs - tlo_cache[i].measured_secs);
+					} else {
+						THEKERNEL->streams->printf("tool%d -- not cached\n", i);
+					}
+				}
 			}
 		}
     } else if (gcode->has_g && gcode->g == 28 && gcode->subcode == 0) {
@@ -1146,16 +1306,15 @@ void ATCHandler::on_main_loop(void *argument)
             }
         }
 
-        while (!this->script_queue.empty()) {
-        	THEKERNEL->streams->printf("%s\r\n", this->script_queue.front().c_str());
-			struct SerialMessage message;
-			message.message = this->script_queue.front();
-			message.stream = THEKERNEL->streams;
-			message.line = 0;
-			this->script_queue.pop();
-
-			// waits for the queue to have enough room
-			THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+        if (!this->script_queue.empty()) {
+        	// a run of moves is queued in one go so the planner can blend them, anything else runs on its own
+        	bool was_move;
+        	do {
+        		atc_cmd cmd = this->script_queue.front();
+        		this->script_queue.pop();
+        		was_move = cmd.type != atc_cmd::CODE;
+        		run_script_cmd(cmd);
+        	} while (was_move && !this->script_queue.empty() && this->script_queue.front().type != atc_cmd::CODE && !THEKERNEL->is_halted());
             return;
         }
 
@@ -1221,6 +1380,104 @@ void ATCHandler::on_main_loop(void *argument)
     }
 }
 
+void ATCHandler::run_script_cmd(const atc_cmd &cmd)
+{
+	char buff[100];
+	cmd.format(buff, sizeof(buff));
+	THEKERNEL->streams->printf("%s\r\n", buff);
+
+	if (cmd.type != atc_cmd::CODE) {
+		run_script_move(cmd);
+		return;
+	}
+	if (run_script_code(cmd)) return;
+
+	// M5 and the G10 and G32 of the probing scripts, their modules only take a Gcode
+	Gcode gc(buff, THEKERNEL->streams);
+	THEKERNEL->call_event(ON_GCODE_RECEIVED, &gc);
+	if (gc.is_error) {
+		THEKERNEL->streams->printf("Error: %s\r\nEntering Alarm/Halt state\n", gc.txt_after_ok.empty() ? "unknown" : gc.txt_after_ok.c_str());
+		THEKERNEL->call_event(ON_HALT, nullptr);
+	}
+}
+
+// same target and feed rate the G0/G1 would get, segmented and compensated by the robot like a gcode move
+void ATCHandler::run_script_move(const atc_cmd &cmd)
+{
+	static const Robot::MOVE_COORDS coords[] = {Robot::MOVE_MCS, Robot::MOVE_WCS, Robot::MOVE_REL};
+	float param[3];
+	for (int i = X_AXIS; i <= Z_AXIS; i ++) {
+		float v = cmd.get_arg('X' + i);
+		param[i] = isnan(v) ? NAN : THEROBOT->to_millimeters(v);
+	}
+
+	float rate = cmd.get_arg('F');
+	if (!isnan(rate)) {
+		rate = THEROBOT->to_millimeters(rate);
+	} else {
+		rate = cmd.num == 0 ? THEROBOT->get_seek_rate() : THEROBOT->get_feed_rate();
+	}
+	THEROBOT->move_to(param, coords[cmd.type], rate / THEROBOT->get_seconds_per_minute());
+}
+
+// the probes and the codes the scripts use, run straight from the command, false if it has to go as a Gcode
+bool ATCHandler::run_script_code(const atc_cmd &cmd)
+{
+	if (cmd.letter == 'G') {
+		if (cmd.num != 38) return false;
+		struct zprobe_move m;
+		m.subcode = cmd.subcode;
+		m.x = isnan(cmd.get_arg('X')) ? 0 : cmd.get_arg('X');
+		m.y = isnan(cmd.get_arg('Y')) ? 0 : cmd.get_arg('Y');
+		m.z = isnan(cmd.get_arg('Z')) ? 0 : cmd.get_arg('Z');
+		m.feedrate = cmd.get_arg('F');
+		PublicData::set_value(zprobe_checksum, straight_probe_checksum, &m);
+		return true;
+	}
+
+	switch (cmd.num) {
+		case 490:
+			if (cmd.subcode == 1) {
+				clamp_tool();
+			} else if (cmd.subcode == 2) {
+				loose_tool();
+			} else {
+				return false;
+			}
+			break;
+		case 491:
+			if (cmd.subcode != 2) return false;
+			check_tool_break(cmd.get_arg('H'), cmd.get_arg('P'));
+			break;
+		case 492:
+			check_tool_detect(cmd.subcode);
+			break;
+		case 493:
+			if (cmd.subcode == 1) {
+				set_tool_offset();
+			} else if (cmd.subcode == 2) {
+				set_active_tool(cmd.get_arg('T'));
+			} else if (cmd.subcode == 3) {
+				use_cached_tlo(cmd.get_arg('T'));
+			} else if (cmd.subcode == 5) {
+				check_tlo_spot();
+			} else {
+				return false;
+			}
+			break;
+		case 494:
+			if (cmd.subcode > 2) return false;
+			this->probe_laser_last = cmd.subcode == 2 ? 9999 : 0;
+			break;
+		case 497:
+			set_atc_state(cmd.subcode);
+			break;
+		default:
+			return false;
+	}
+	return true;
+}
+
 // issue a coordinated move directly to robot, and return when done
 // Only move the coordinates that are passed in as not nan
 // NOTE must use G53 to force move in machine coordinates and ignore any WCS offsets
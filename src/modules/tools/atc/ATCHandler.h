@@ -18,6 +18,7 @@ public:
     void on_set_public_data(void *argument);
     void on_main_loop( void* argument );
     void on_halt(void *argument);
+    void on_second_tick(void *argument);
     int get_active_tool() const { return active_tool; }
     void on_config_reload(void *argument);
 
@@ -71,11 +72,25 @@ private:
 
     // set tool offset afteer calibrating
     void set_tool_offset();
+    void apply_tool_mz(float mz);
+
+    // tool length cache
+    void invalidate_tlo_cache(int tool);
+    void check_tlo_spot();
+
+    // bodies of the M491.2 to M497 codes, shared by the gcode handler and the scripts
+    void check_tool_break(float tolerance, float tlo);
+    void check_tool_detect(uint8_t subcode);
+    void set_active_tool(int tool);
+    void use_cached_tlo(int tool);
+    void set_atc_state(uint8_t state);
 
     //
     void fill_drop_scripts(int old_tool);
     void fill_pick_scripts(int new_tool, bool clear_z);
     void fill_cali_scripts(bool is_probe, bool clear_z);
+    void fill_tool_cali_scripts(int new_tool, bool clear_z);
+    void fill_spot_check_scripts(int new_tool, bool clear_z);
 
     //
     void fill_margin_scripts(float x_pos, float y_pos, float x_pos_max, float y_pos_max);
@@ -92,7 +107,39 @@ private:
 
     void rapid_move(bool mc, float x, float y, float z);
 
-    std::queue<string> script_queue;
+    // one step of a script, moves go straight to the robot and probes to the zprobe, the atc's own codes are run
+    // directly and only the M5, G10 and G32 handled by other modules still go as a Gcode
+    // values are kept as they would be written in gcode, so in the current units
+    struct atc_cmd {
+    	enum TYPE : uint8_t {
+    		MOVE_MCS,	// G53 G0/G1
+    		MOVE_WCS,	// G90 G0/G1
+    		MOVE_REL,	// G91 G0/G1
+    		CODE		// any other G or M code
+    	};
+
+    	static atc_cmd move(TYPE type, uint16_t g);
+    	static atc_cmd code(char letter, uint16_t num, uint8_t subcode = 0);
+    	atc_cmd& arg(char letter, float value);
+    	atc_cmd& in_spot_check();
+    	float get_arg(char letter) const;
+    	void format(char *buf, size_t size) const;
+
+    	TYPE type;
+    	char letter;
+    	uint8_t subcode;
+    	uint8_t nargs;
+    	bool spot_check;	// left out if the tool length spot check fails
+    	uint16_t num;
+    	char arg_letters[8];
+    	float arg_values[8];
+    };
+
+    void run_script_cmd(const atc_cmd &cmd);
+    void run_script_move(const atc_cmd &cmd);
+    bool run_script_code(const atc_cmd &cmd);
+
+    std::queue<atc_cmd> script_queue;
 
     uint16_t debounce;
     bool atc_homing;
@@ -169,6 +216,19 @@ private:
 
     vector<struct atc_tool> atc_tools;
 
+    // last measured length of the tool in each slot, lets a pick skip or shorten calibration
+    struct tlo_cache_entry {
+    	float mz_mm;
+    	uint32_t measured_secs;
+    	bool valid;
+    };
+
+    vector<struct tlo_cache_entry> tlo_cache;
+    bool tlo_cache_enable;
+    uint32_t tlo_cache_max_age_s;
+    float tlo_spot_check_mm;
+    uint32_t uptime_secs;
+
     int active_tool;
     int tool_number;
     int goto_position;
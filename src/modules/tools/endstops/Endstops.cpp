@@ -130,9 +130,12 @@ void Endstops::on_module_loaded()
         }
     }
 
-    register_for_event(ON_GCODE_RECEIVED);
-    register_for_event(ON_GET_PUBLIC_DATA);
-    register_for_event(ON_SET_PUBLIC_DATA);
+    register_for_gcode('G', 28);
+    for (uint16_t m : {119, 206, 306, 500, 503, 665, 666}) {
+        register_for_gcode('M', m);
+    }
+    register_for_public_data(ON_GET_PUBLIC_DATA, endstops_checksum);
+    register_for_public_data(ON_SET_PUBLIC_DATA, endstops_checksum);
 
 
     THEKERNEL->slow_ticker->attach(1000, this, &Endstops::read_endstops);
@@ -112,9 +112,11 @@ void Laser::on_module_loaded()
 
     //register for events
     this->register_for_event(ON_HALT);
-    this->register_for_event(ON_GCODE_RECEIVED);
+    for (uint16_t m : {3, 5, 321, 322, 323, 324, 325}) {
+        this->register_for_gcode('M', m);
+    }
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, laser_checksum);
 
     // no point in updating the power more than the PWM frequency, but not faster than 1KHz
     ms_per_tick = 1000 / std::min(1000UL, 1000000 / period);
@@ -26,6 +26,8 @@
 #include "port_api.h"
 #include "us_ticker_api.h"
 
+#include <math.h>
+
 #define spindle_checksum                    CHECKSUM("spindle")
 #define spindle_pwm_pin_checksum            CHECKSUM("pwm_pin")
 #define spindle_pwm_period_checksum         CHECKSUM("pwm_period")
@@ -43,8 +45,14 @@
 #define spindle_stall_s_checksum			CHECKSUM("stall_s")
 #define spindle_stall_count_rpm_checksum	CHECKSUM("stall_count_rpm")
 #define spindle_stall_alarm_rpm_checksum	CHECKSUM("stall_alarm_rpm")
+#define spindle_ready_check_checksum		CHECKSUM("ready_check")
+#define spindle_ready_tolerance_checksum	CHECKSUM("ready_tolerance_pct")
+#define spindle_stop_rpm_checksum			CHECKSUM("stop_rpm")
+#define spindle_ready_timeout_s_checksum	CHECKSUM("ready_timeout_s")
 
 #define UPDATE_FREQ 100
+// how long the measured speed has to stay in the band before the spindle counts as ready
+#define READY_SETTLE_US 250000
 
 PWMSpindleControl::PWMSpindleControl()
 {
@@ -61,6 +69,8 @@ void PWMSpindleControl::on_module_loaded()
     stall_timer = 0;
     
     spindle_on = false;
+    stop_pending = false;
+    stopped_us = 0;
     
     factor = 100;
 
@@ -77,6 +87,11 @@ void PWMSpindleControl::on_module_loaded()
     acc_ratio      = THEKERNEL->config->value(spindle_checksum, spindle_acc_ratio_checksum)->by_default(1.0f)->as_number();
     alarm_pin.from_string(THEKERNEL->config->value(spindle_checksum, spindle_alarm_pin_checksum)->by_default("nc")->as_string())->as_input();
 
+    ready_check     = THEKERNEL->config->value(spindle_checksum, spindle_ready_check_checksum)->by_default(false)->as_bool();
+    ready_tolerance = THEKERNEL->config->value(spindle_checksum, spindle_ready_tolerance_checksum)->by_default(10.0f)->as_number() / 100.0f;
+    stop_rpm        = THEKERNEL->config->value(spindle_checksum, spindle_stop_rpm_checksum)->by_default(500.0f)->as_number();
+    ready_timeout_s = THEKERNEL->config->value(spindle_checksum, spindle_ready_timeout_s_checksum)->by_default(15)->as_number();
+
     // Smoothing value is low pass filter time constant in seconds.
     float smoothing_time = THEKERNEL->config->value(spindle_checksum, spindle_control_smoothing_checksum)->by_default(0.1f)->as_number();
     if (smoothing_time * UPDATE_FREQ < 1.0f)
@@ -208,18 +223,24 @@ uint32_t PWMSpindleControl::on_update_speed(uint32_t dummy)
 
 void PWMSpindleControl::turn_on() {
     spindle_on = true;
-    if (delay_s > 0) {
-        char buf[80];
-        size_t n = snprintf(buf, sizeof(buf), "G4P%d", delay_s);
-        if(n > sizeof(buf)) n= sizeof(buf);
-        string g(buf, n);
-        Gcode gcode(g, &(StreamOutput::NullStream));
-        THEKERNEL->call_event(ON_GCODE_RECEIVED, &gcode);
+    if (ready_check) {
+        wait_for_speed(true);
+    } else {
+        dwell();
     }
 }
 
 void PWMSpindleControl::turn_off() {
     spindle_on = false;
+    stop_pending = false;
+    if (ready_check) {
+        wait_for_speed(false);
+    } else {
+        dwell();
+    }
+}
+
+void PWMSpindleControl::dwell() {
     if (delay_s > 0) {
         char buf[80];
         size_t n = snprintf(buf, sizeof(buf), "G4P%d", delay_s);
@@ -230,6 +251,49 @@ void PWMSpindleControl::turn_off() {
     }
 }
 
+// wait until the measured rpm is within tolerance of the target (on) or below stop_rpm (off), alarm on timeout
+void PWMSpindleControl::wait_for_speed(bool on) {
+    // turned off by a halt, nothing to wait for
+    if (THEKERNEL->is_halted()) return;
+
+    uint32_t start = us_ticker_read();
+    uint32_t in_band = 0;
+    while (!THEKERNEL->is_halted()) {
+        float target = target_rpm * (factor / 100);
+        bool ok = on ? fabsf(current_rpm - target) <= target * ready_tolerance : current_rpm < stop_rpm;
+        uint32_t now = us_ticker_read();
+        if (!ok) {
+            in_band = 0;
+        } else if (in_band == 0) {
+            in_band = now;
+        } else if (now - in_band >= READY_SETTLE_US) {
+            return;
+        }
+
+        if (now - start > (uint32_t)ready_timeout_s * 1000000) {
+            THEKERNEL->streams->printf("ALARM: Spindle did not %s within %d s, current RPM: %5.0f\n", on ? "reach speed" : "stop", ready_timeout_s, current_rpm);
+            THEKERNEL->call_event(ON_HALT, nullptr);
+            THEKERNEL->set_halt_reason(SPINDLE_STALL);
+            return;
+        }
+        THEKERNEL->call_event(ON_IDLE);
+    }
+}
+
+
+// the wait turn_off does, for a stop started earlier with stop_spindle so it could overlap other work
+void PWMSpindleControl::wait_stopped() {
+    if (!stop_pending || spindle_on) return;
+    stop_pending = false;
+    if (ready_check) {
+        wait_for_speed(false);
+        return;
+    }
+    uint32_t elapsed_ms = (us_ticker_read() - stopped_us) / 1000;
+    if (delay_s > 0 && elapsed_ms < (uint32_t)delay_s * 1000) {
+        safe_delay_ms(delay_s * 1000 - elapsed_ms);
+    }
+}
 
 void PWMSpindleControl::set_speed(int rpm) {
     target_rpm = rpm;
@@ -291,6 +355,14 @@ void PWMSpindleControl::on_set_public_data(void* argument)
     if(pdr->second_element_is(turn_off_spindle_checksum)) {
         this->turn_off();
         pdr->set_taken();
+    } else if(pdr->second_element_is(stop_spindle_checksum)) {
+        this->spindle_on = false;
+        this->stopped_us = us_ticker_read();
+        this->stop_pending = true;
+        pdr->set_taken();
+    } else if(pdr->second_element_is(wait_spindle_stopped_checksum)) {
+        this->wait_stopped();
+        pdr->set_taken();
     }
 }
 
@@ -62,6 +62,14 @@ class PWMSpindleControl: public SpindleControl {
         float acc_ratio;
         Pin alarm_pin;
 
+        // wait on the measured speed instead of a fixed delay after M3/M5
+        bool ready_check;
+        float ready_tolerance;
+        float stop_rpm;
+        int ready_timeout_s;
+        uint32_t stopped_us;   // when stop_spindle turned it off
+        bool stop_pending;     // stop_spindle has not been waited for yet
+
         // These fields are updated by the interrupt
         uint32_t last_edge; // Timestamp of last edge
         volatile uint32_t last_time; // Time delay between last two edges
@@ -77,6 +85,9 @@ class PWMSpindleControl: public SpindleControl {
 
         void turn_on(void);
         void turn_off(void);
+        void dwell(void);
+        void wait_for_speed(bool on);
+        void wait_stopped(void);
         void set_speed(int);
         void report_speed(void);
         void set_p_term(float);
@@ -8,6 +8,8 @@
 #define pwm_spindle_control_checksum		CHECKSUM("pwm_spindle_control")
 #define get_spindle_status_checksum    CHECKSUM("get_spindle_status")
 #define turn_off_spindle_checksum    CHECKSUM("turn_off_spindle_status")
+#define stop_spindle_checksum        CHECKSUM("stop_spindle")          // turn off without waiting for it to stop
+#define wait_spindle_stopped_checksum CHECKSUM("wait_spindle_stopped") // wait until a stop_spindle has taken effect
 
 struct spindle_status {
 	bool state;
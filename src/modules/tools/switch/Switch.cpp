@@ -85,8 +85,8 @@ void Switch::on_module_loaded()
 
     this->register_for_event(ON_GCODE_RECEIVED);
     this->register_for_event(ON_MAIN_LOOP);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, switch_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, switch_checksum);
     this->register_for_event(ON_HALT);
 
     // Settings
@@ -95,14 +95,16 @@ void TemperatureControl::on_module_loaded()
     this->load_config();
 
     // Register for events
-    this->register_for_event(ON_GCODE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
+    for (uint16_t m : {(uint16_t)this->get_m_code, (uint16_t)this->set_m_code, (uint16_t)this->set_and_wait_m_code, (uint16_t)143, (uint16_t)301, (uint16_t)305, (uint16_t)500, (uint16_t)503}) {
+        this->register_for_gcode('M', m);
+    }
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, temperature_control_checksum);
     this->register_for_event(ON_IDLE);
     this->register_for_event(ON_SECOND_TICK);
 
     if(!this->readonly) {
         this->register_for_event(ON_MAIN_LOOP);
-        this->register_for_event(ON_SET_PUBLIC_DATA);
+        this->register_for_public_data(ON_SET_PUBLIC_DATA, temperature_control_checksum);
         this->register_for_event(ON_HALT);
     }
 }
@@ -62,6 +62,15 @@
         leveling-strategy.rectangular-grid.after_probe_gcode M281
 
 
+    Fast probing predicts the bed height at each point from the points already probed, retracts only
+    retract_margin above the higher of the last contact and the prediction, and when the neighbouring
+    estimates agree within confidence_tolerance touches the bed directly at slow feedrate. Otherwise it
+    does a fast approach, backs off retract_margin and touches again slowly. Default is disabled.
+
+      leveling-strategy.rectangular-grid.fast_probe            true
+      leveling-strategy.rectangular-grid.retract_margin        1.0
+      leveling-strategy.rectangular-grid.confidence_tolerance  0.2
+
     Usage
     -----
     G29 test probes a rectangle of width Xnnn and Ynnn starting at the current XY probe position, optionally Innn Jnnn can be used to change the grid size
@@ -125,6 +134,9 @@
 #define dampening_start_checksum     CHECKSUM("dampening_start")
 #define before_probe_gcode_checksum  CHECKSUM("before_probe_gcode")
 #define after_probe_gcode_checksum   CHECKSUM("after_probe_gcode")
+#define fast_probe_checksum          CHECKSUM("fast_probe")
+#define retract_margin_checksum      CHECKSUM("retract_margin")
+#define confidence_tolerance_checksum CHECKSUM("confidence_tolerance")
 
 #define GRIDFILE "/sd/cartesian.grid"
 #define GRIDFILE_NM "/sd/cartesian_nm.grid"
@@ -155,6 +167,9 @@ bool CartGridStrategy::handleConfig()
     only_by_two_corners = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, only_by_two_corners_checksum)->by_default(false)->as_bool();
     human_readable = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, human_readable_checksum)->by_default(false)->as_bool();
     do_manual_attach = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, m_attach_checksum)->by_default(false)->as_bool();
+    fast_probe = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, fast_probe_checksum)->by_default(false)->as_bool();
+    retract_margin = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, retract_margin_checksum)->by_default(1.0F)->as_number();
+    confidence_tolerance = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, confidence_tolerance_checksum)->by_default(0.2F)->as_number();
 
     this->height_limit = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, height_limit_checksum)->by_default(NAN)->as_number();
     this->dampening_start = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, dampening_start_checksum)->by_default(NAN)->as_number();
@@ -517,6 +532,90 @@ bool CartGridStrategy::findBed(float x, float y, float z)
     return true;
 }
 
+// estimate the bed height at grid point xc,yc from the points already probed in serpentine order,
+// xdir is the direction the current row is being probed in.
+// confident is set when at least two independent extrapolations agree within confidence_tolerance
+bool CartGridStrategy::predict_height(int xc, int yc, int xdir, float &z, bool &confident)
+{
+    auto g= [this](int x, int y) {
+        if(x < 0 || y < 0 || x >= current_grid_x_size || y >= current_grid_y_size) return NAN;
+        return grid[x + (current_grid_x_size * y)];
+    };
+
+    float left= g(xc - xdir, yc), left2= g(xc - 2 * xdir, yc);
+    float up= g(xc, yc - 1), up2= g(xc, yc - 2);
+    float diag= g(xc - xdir, yc - 1);
+
+    float est[3];
+    int n= 0;
+    if(!isnan(left) && !isnan(left2)) est[n++]= 2 * left - left2; // along the row
+    if(!isnan(up) && !isnan(up2)) est[n++]= 2 * up - up2;         // along the column
+    if(!isnan(left) && !isnan(up) && !isnan(diag)) est[n++]= left + up - diag; // local plane
+
+    confident= false;
+    if(n == 0) {
+        // no trend to go on, use the nearest neighbour if there is one
+        if(!isnan(left)) { z= left; return true; }
+        if(!isnan(up)) { z= up; return true; }
+        return false;
+    }
+
+    float lo= est[0], hi= est[0], sum= 0;
+    for (int i = 0; i < n; ++i) {
+        lo= std::min(lo, est[i]);
+        hi= std::max(hi, est[i]);
+        sum += est[i];
+    }
+    z= sum / n;
+    confident= (n >= 2 && (hi - lo) <= confidence_tolerance);
+    return true;
+}
+
+// probe grid point xc,yc at machine x,y retracting only as far as the predicted bed height needs,
+// reference is the machine Z of the first contact, contact is passed in as the machine Z of the
+// previous contact and returns the machine Z of this one
+bool CartGridStrategy::probe_adaptive(int xc, int yc, int xdir, float x, float y, float reference, float height, float &contact)
+{
+    float pred;
+    bool confident;
+    float cur_z= THEROBOT->get_axis_position(Z_AXIS);
+    float bed= predict_height(xc, yc, xdir, pred, confident) ? reference + pred : reference;
+
+    // clear both the point we are leaving and the point we expect to touch
+    float clearance= confident ? retract_margin : height;
+    float travel_z= std::max(contact, bed) + clearance;
+
+    // never drag the probe across the bed, go up before moving over and down after
+    if(travel_z >= cur_z) {
+        zprobe->coordinated_move(NAN, NAN, travel_z, zprobe->getFastFeedrate());
+        zprobe->coordinated_move(x, y, NAN, zprobe->getFastFeedrate() * 4);
+    } else {
+        zprobe->coordinated_move(x, y, NAN, zprobe->getFastFeedrate() * 4);
+        zprobe->coordinated_move(NAN, NAN, travel_z, zprobe->getFastFeedrate());
+    }
+
+    float mm;
+    if(confident) {
+        // the bed should be just below us so touch it once slowly, only if it is not where we expected do the full sequence
+        float z0= THEROBOT->get_axis_position(Z_AXIS);
+        if(zprobe->run_probe(mm, zprobe->getSlowFeedrate(), clearance + 2 * confidence_tolerance)) {
+            contact= z0 - mm;
+            return true;
+        }
+        if(THEKERNEL->is_halted()) return false;
+    }
+
+    // fast approach to find the bed, back off and then touch slowly for the accurate reading
+    if(!zprobe->run_probe(mm, zprobe->getFastFeedrate())) return false;
+    zprobe->coordinated_move(NAN, NAN, retract_margin, zprobe->getFastFeedrate(), true); // relative move
+    float z0= THEROBOT->get_axis_position(Z_AXIS);
+    if(!zprobe->run_probe(mm, zprobe->getSlowFeedrate(), retract_margin * 2)) return false;
+
+    // from the latched trigger like reference_contact, the stop position includes the deceleration overshoot
+    contact= z0 - mm;
+    return true;
+}
+
 bool CartGridStrategy::scan_bed(Gcode *gc)
 {
     float _x_start, _y_start, _x_size, _y_size;
@@ -629,6 +728,9 @@ bool CartGridStrategy::doProbe(Gcode *gc)
         return false;
     }
 
+    // the grid is indexed by the new size now, make sure no stale values are left for fast probing to predict from
+    reset_bed_level();
+
     if (do_manual_attach) {
         // Move to the attachment point defined
         zprobe->coordinated_move( m_attach[0], m_attach[1], m_attach[2], zprobe->getFastFeedrate());
@@ -654,8 +756,11 @@ bool CartGridStrategy::doProbe(Gcode *gc)
 
     // do first probe at start point
     float mm;
+    float start_z= THEROBOT->get_axis_position(Z_AXIS);
     if(!zprobe->doProbeAt(mm, this->x_start - X_PROBE_OFFSET_FROM_EXTRUDER, this->y_start - Y_PROBE_OFFSET_FROM_EXTRUDER)) return false;
     float z_reference = (gc->has_letter('H') ? gc->get_value('H') : zprobe->getProbeHeight()) - mm; // this should be zero
+    float reference_contact= start_z - mm; // machine Z where the probe touched at the start point
+    float contact= reference_contact;
     gc->stream->printf("probe at 0,0 is %1.3f mm\n", z_reference);
 
     // keep track of worst case delta
@@ -678,17 +783,32 @@ bool CartGridStrategy::doProbe(Gcode *gc)
         for (int xCount = xStart; xCount != xStop; xCount += xInc) {
             float xProbe = this->x_start + (this->x_size / (this->current_grid_x_size - 1)) * xCount;
 
-            if(!zprobe->doProbeAt(mm, xProbe - X_PROBE_OFFSET_FROM_EXTRUDER, yProbe - Y_PROBE_OFFSET_FROM_EXTRUDER)){
-                return false;
-            }
+            float measured_z;
+            if(fast_probe) {
+                if(!probe_adaptive(xCount, yCount, xInc, xProbe - X_PROBE_OFFSET_FROM_EXTRUDER, yProbe - Y_PROBE_OFFSET_FROM_EXTRUDER,
+                                   reference_contact, gc->has_letter('H') ? gc->get_value('H') : zprobe->getProbeHeight(), contact)) {
+                    return false;
+                }
+                measured_z = contact - reference_contact; // this is the delta z from bed at 0,0
+
+            } else {
+                if(!zprobe->doProbeAt(mm, xProbe - X_PROBE_OFFSET_FROM_EXTRUDER, yProbe - Y_PROBE_OFFSET_FROM_EXTRUDER)){
+                    return false;
+                }
 
-            float measured_z = (gc->has_letter('H') ? gc->get_value('H') : zprobe->getProbeHeight()) - mm - z_reference; // this is the delta z from bed at 0,0
+                measured_z = (gc->has_letter('H') ? gc->get_value('H') : zprobe->getProbeHeight()) - mm - z_reference; // this is the delta z from bed at 0,0
+            }
             gc->stream->printf("DEBUG: X%1.3f, Y%1.3f, Z%1.3f\n", xProbe, yProbe, measured_z);
             grid[xCount + (this->current_grid_x_size * yCount)] = measured_z;
             if(fabs(measured_z) > max_delta) max_delta= fabs(measured_z);
         }
     }
 
+    if(fast_probe) {
+        // fast probing leaves the probe on the bed, lift it back to the probe height
+        zprobe->coordinated_move(NAN, NAN, gc->has_letter('H') ? gc->get_value('H') : zprobe->getProbeHeight(), zprobe->getFastFeedrate(), true);
+    }
+
     print_bed_level(gc->stream);
 
     gc->stream->printf("Maximum delta: %1.3f\n", max_delta);
@@ -23,6 +23,8 @@ private:
     bool doProbe(Gcode *gc);
     bool scan_bed(Gcode *gc);
     bool findBed(float x, float y, float z);
+    bool predict_height(int xc, int yc, int xdir, float &z, bool &confident);
+    bool probe_adaptive(int xc, int yc, int xdir, float x, float y, float reference, float height, float &contact);
     void setAdjustFunction(bool on);
     void print_bed_level(StreamOutput *stream);
     void doCompensation(float *target, bool inverse, bool debug);
@@ -32,6 +34,8 @@ private:
 
     float initial_height;
     float tolerance;
+    float retract_margin;
+    float confidence_tolerance;
 
     float height_limit;
     float dampening_start;
@@ -58,5 +62,6 @@ private:
         bool only_by_two_corners:1;
         bool human_readable:1;
         bool new_file_format:1;
+        bool fast_probe:1;
     };
 };
@@ -73,7 +73,9 @@ void ZProbe::on_module_loaded()
     this->config_load();
     // register event-handlers
     register_for_event(ON_GCODE_RECEIVED);
-    register_for_event(ON_GET_PUBLIC_DATA);
+    register_for_public_data(ON_GET_PUBLIC_DATA, zprobe_checksum);
+    register_for_public_data(ON_SET_PUBLIC_DATA, zprobe_checksum);
+    register_for_event(ON_IDLE);
 
     // we read the probe in this timer
     probing = false;
@@ -176,6 +178,8 @@ uint32_t ZProbe::read_probe(uint32_t dummy)
         } else {
             // The endstop was not hit yet
             debounce = 0;
+            // a trigger that did not survive debounce was noise, let the step ISR latch the next one
+            if(debounce_ms > 0) THEKERNEL->step_ticker->reset_probe_latch();
         }
     }
 
@@ -229,10 +233,14 @@ bool ZProbe::run_probe(float& mm, float feedrate, float max_dist, bool reverse)
     probe_detected = false;
     debounce = 0;
     cali_debounce = 0;
+    digitizing = false;
 
     // save current actuator position so we can report how far we moved
     float z_start_pos= THEROBOT->actuators[Z_AXIS]->get_current_position();
 
+    // the step ISR latches the actuator positions on the trigger edge, and stops the motors itself if there is no debounce
+    THEKERNEL->step_ticker->arm_probe_latch(&this->pin, invert_probe, debounce_ms == 0);
+
     // move Z down
     bool dir= (!reverse_z != reverse); // xor
     float delta[3]= {0,0,0};
@@ -243,11 +251,21 @@ bool ZProbe::run_probe(float& mm, float feedrate, float max_dist, bool reverse)
 
     // wait until finished
     THECONVEYOR->wait_for_idle();
+
+    StepTicker::probe_latch_t latch;
+    bool latched= THEKERNEL->step_ticker->get_probe_latch(latch);
+    THEKERNEL->step_ticker->disarm_probe_latch();
+    if(latched && debounce_ms == 0) probe_detected= true; // the ISR stopped the move so the probe poll never saw it
     if(THEKERNEL->is_halted()) return false;
 
     // now see how far we moved, get delta in z we moved
     // NOTE this works for deltas as well as all three actuators move the same amount in Z
-    mm = z_start_pos - THEROBOT->actuators[2]->get_current_position();
+    // when triggered use the position latched on the edge rather than where the motors came to a stop
+    if(probe_detected && latched) {
+        mm = z_start_pos - latch.steps[Z_AXIS] / Z_STEPS_PER_MM;
+    } else {
+        mm = z_start_pos - THEROBOT->actuators[2]->get_current_position();
+    }
 
     // set the last probe position to the actuator units moved during this home
     THEROBOT->set_last_probe_position(std::make_tuple(0, 0, mm, probe_detected ? 1:0));
@@ -367,32 +385,10 @@ void ZProbe::on_gcode_received(void *argument)
         }
 
     } else if(gcode->has_g && gcode->g == 38 ) { // G38.2 Straight Probe with error, G38.3 straight probe without error
-        // linuxcnc/grbl style probe http://www.linuxcnc.org/docs/2.5/html/gcode/gcode.html#sec:G38-probe
-        if(gcode->subcode < 2 || gcode->subcode > 6) {
-            gcode->stream->printf("Error :Only G38.2 to G38.5 are supported\n");
-            return;
-        }
-
-        // make sure the probe is defined and not already triggered before moving motors
-        if(!this->pin.connected()) {
-            gcode->stream->printf("Error :ZProbe not connected.\n");
-            return;
-        }
-
-        if (gcode->subcode == 4 || gcode->subcode == 5) {
-            invert_probe = true;
-        } else {
-            invert_probe = false;
-        }
-
-        if (gcode->subcode == 6) {
-            calibrate_Z(gcode);
-        } else {
-            probe_XYZ(gcode);
-        }
-
-        invert_probe = false;
-
+        float x= gcode->has_letter('X') ? gcode->get_value('X') : 0;
+        float y= gcode->has_letter('Y') ? gcode->get_value('Y') : 0;
+        float z= gcode->has_letter('Z') ? gcode->get_value('Z') : 0;
+        straight_probe(gcode->subcode, x, y, z, gcode->has_letter('F') ? gcode->get_value('F') : NAN, gcode->stream);
         return;
 
     } else if(gcode->has_m) {
@@ -419,6 +415,22 @@ void ZProbe::on_gcode_received(void *argument)
                 if (gcode->has_letter('D')) this->dwell_before_probing = gcode->get_value('D');
                 break;
 
+            case 675: // M675 S1 start digitizing, every probe contact/release on following moves is reported as [DIG:x,y,z:1/0], M675 S0 stop
+                THEKERNEL->conveyor->wait_for_idle();
+                if (gcode->has_letter('S') && gcode->get_value('S') != 0) {
+                    if(!this->pin.connected()) {
+                        gcode->stream->printf("Error :ZProbe not connected.\n");
+                        break;
+                    }
+                    THEKERNEL->step_ticker->arm_digitize(&this->pin, false);
+                    digitizing = true;
+                } else if (digitizing) {
+                    on_idle(nullptr); // report anything still queued
+                    digitizing = false;
+                    THEKERNEL->step_ticker->disarm_probe_latch();
+                }
+                break;
+
             case 500: // save settings
             case 503: // print settings
                 gcode->stream->printf(";Probe feedrates Slow/fast(K)/Return (mm/sec) max_z (mm) height (mm) dwell (s):\nM670 S%1.2f K%1.2f R%1.2f Z%1.2f H%1.2f D%1.2f\n",
@@ -437,34 +449,51 @@ void ZProbe::on_gcode_received(void *argument)
 }
 
 // special way to probe in the X or Y or Z direction using planned moves, should work with any kinematics
-void ZProbe::probe_XYZ(Gcode *gcode)
+// G38.x, feedrate in mm/min or nan for the slow feedrate, also run by the tool change scripts through public data
+void ZProbe::straight_probe(uint8_t subcode, float x, float y, float z, float feedrate, StreamOutput *stream)
 {
-    float x= 0, y= 0, z= 0;
-    if(gcode->has_letter('X')) {
-        x= gcode->get_value('X');
+    // linuxcnc/grbl style probe http://www.linuxcnc.org/docs/2.5/html/gcode/gcode.html#sec:G38-probe
+    // G38.6 calibrate with the calibrate pin with error, G38.7 calibrate without error
+    if(subcode < 2 || subcode > 7) {
+        stream->printf("Error :Only G38.2 to G38.7 are supported\n");
+        return;
     }
 
-    if(gcode->has_letter('Y')) {
-        y= gcode->get_value('Y');
+    // make sure the probe is defined and not already triggered before moving motors
+    if(!this->pin.connected()) {
+        stream->printf("Error :ZProbe not connected.\n");
+        return;
     }
 
-    if(gcode->has_letter('Z')) {
-        z= gcode->get_value('Z');
+    if (subcode == 4 || subcode == 5) {
+        invert_probe = true;
+    } else {
+        invert_probe = false;
+    }
+
+    // convert the feedrate to mm/sec
+    float rate = isnan(feedrate) ? this->slow_feedrate : feedrate / 60;
+    if (subcode == 6 || subcode == 7) {
+        calibrate_Z(subcode, z, rate, stream);
+    } else {
+        probe_XYZ(subcode, x, y, z, rate, stream);
     }
 
+    invert_probe = false;
+}
+
+void ZProbe::probe_XYZ(uint8_t subcode, float x, float y, float z, float rate, StreamOutput *stream)
+{
     if(x == 0 && y == 0 && z == 0) {
-        gcode->stream->printf("error:at least one of X Y or Z must be specified, and be > or < 0\n");
+        stream->printf("error:at least one of X Y or Z must be specified, and be > or < 0\n");
         return;
     }
 
-    // get probe feedrate in mm/min and convert to mm/sec if specified
-    float rate = (gcode->has_letter('F')) ? gcode->get_value('F')/60 : this->slow_feedrate;
-
     // first wait for all moves to finish
     THEKERNEL->conveyor->wait_for_idle();
 
     if(this->pin.get() != invert_probe) {
-        gcode->stream->printf("Error:ZProbe triggered before move, aborting command.\n");
+        stream->printf("Error:ZProbe triggered before move, aborting command.\n");
         THEKERNEL->call_event(ON_HALT, nullptr);
         THEKERNEL->set_halt_reason(PROBE_FAIL);
         return;
@@ -475,16 +504,21 @@ void ZProbe::probe_XYZ(Gcode *gcode)
     probe_detected = false;
     debounce = 0;
     cali_debounce = 0;
+    digitizing = false;
+
+    // the step ISR latches the actuator positions on the trigger edge, and stops the motors itself if there is no debounce
+    THEKERNEL->step_ticker->arm_probe_latch(&this->pin, invert_probe, debounce_ms == 0);
 
     // do a delta move which will stop as soon as the probe is triggered, or the distance is reached
     float delta[3]= {x, y, z};
     THEKERNEL->set_zprobing(true);
     if(!THEROBOT->delta_move(delta, rate, 3)) {
-    	gcode->stream->printf("ERROR: Move too small,  %1.3f, %1.3f, %1.3f\n", x, y, z);
+    	stream->printf("ERROR: Move too small,  %1.3f, %1.3f, %1.3f\n", x, y, z);
         THEKERNEL->call_event(ON_HALT, nullptr);
         THEKERNEL->set_halt_reason(PROBE_FAIL);
         probing = false;
         THEKERNEL->set_zprobing(false);
+        THEKERNEL->step_ticker->disarm_probe_latch();
         return;
     }
     THEKERNEL->set_zprobing(false);
@@ -494,47 +528,51 @@ void ZProbe::probe_XYZ(Gcode *gcode)
     // disable probe checking
     probing = false;
 
+    StepTicker::probe_latch_t latch;
+    bool latched= THEKERNEL->step_ticker->get_probe_latch(latch);
+    THEKERNEL->step_ticker->disarm_probe_latch();
+    if(latched && debounce_ms == 0) probe_detected= true; // the ISR stopped the move so the probe poll never saw it
+
     // if the probe stopped the move we need to correct the last_milestone as it did not reach where it thought
     // this also sets last_milestone to the machine coordinates it stopped at
     THEROBOT->reset_position_from_current_actuator_position();
     float pos[3];
-    THEROBOT->get_axis_position(pos, 3);
+    if(probe_detected && latched) {
+        // report where the probe triggered, not where the motors came to a stop
+        latch_to_machine(latch.steps, pos);
+    } else {
+        THEROBOT->get_axis_position(pos, 3);
+    }
 
     uint8_t probeok= this->probe_detected ? 1 : 0;
 
     // print results using the GRBL format
-    gcode->stream->printf("[PRB:%1.3f,%1.3f,%1.3f:%d]\n", THEKERNEL->robot->from_millimeters(pos[X_AXIS]), THEKERNEL->robot->from_millimeters(pos[Y_AXIS]), THEKERNEL->robot->from_millimeters(pos[Z_AXIS]), probeok);
+    stream->printf("[PRB:%1.3f,%1.3f,%1.3f:%d]\n", THEKERNEL->robot->from_millimeters(pos[X_AXIS]), THEKERNEL->robot->from_millimeters(pos[Y_AXIS]), THEKERNEL->robot->from_millimeters(pos[Z_AXIS]), probeok);
     THEROBOT->set_last_probe_position(std::make_tuple(pos[X_AXIS], pos[Y_AXIS], pos[Z_AXIS], probeok));
 
-    if(probeok == 0 && (gcode->subcode == 2 || gcode->subcode == 4)) {
+    if(probeok == 0 && (subcode == 2 || subcode == 4)) {
         // issue error if probe was not triggered and subcode is 2 or 4
-        gcode->stream->printf("ALARM: Probe fail\n");
+        stream->printf("ALARM: Probe fail\n");
         THEKERNEL->call_event(ON_HALT, nullptr);
         THEKERNEL->set_halt_reason(PROBE_FAIL);
     }
 }
 
 // just probe / calibrate Z using calibrate pin
-void ZProbe::calibrate_Z(Gcode *gcode)
+void ZProbe::calibrate_Z(uint8_t subcode, float z, float rate, StreamOutput *stream)
 {
-    float z= 0;
-    if(gcode->has_letter('Z')) {
-        z= gcode->get_value('Z');
-    }
-
     if(z == 0) {
-        gcode->stream->printf("error: Z must be specified, and be > or < 0\n");
+        stream->printf("error: Z must be specified, and be > or < 0\n");
         return;
     }
 
-    // get probe feedrate in mm/min and convert to mm/sec if specified
-    float rate = (gcode->has_letter('F')) ? gcode->get_value('F') / 60 : this->slow_feedrate;
-
     // first wait for all moves to finish
     THEKERNEL->conveyor->wait_for_idle();
 
     if (this->calibrate_pin.get()) {
-        gcode->stream->printf("error: ZCalibrate triggered before move, aborting command.\n");
+        stream->printf("error: ZCalibrate triggered before move, aborting command.\n");
+        // make sure whoever checks the result of a G38.7 does not pick up an older probe
+        if (subcode == 7) THEROBOT->set_last_probe_position(std::make_tuple(NAN, NAN, NAN, 0));
         return;
     }
 
@@ -549,7 +587,7 @@ void ZProbe::calibrate_Z(Gcode *gcode)
     float delta[3]= {0, 0, z};
     THEKERNEL->set_zprobing(true);
     if(!THEROBOT->delta_move(delta, rate, 3)) {
-        gcode->stream->printf("ERROR: Move too small,  %1.3f\n", z);
+        stream->printf("ERROR: Move too small,  %1.3f\n", z);
         THEKERNEL->call_event(ON_HALT, nullptr);
         THEKERNEL->set_halt_reason(PROBE_FAIL);
         calibrating = false;
@@ -572,12 +610,12 @@ void ZProbe::calibrate_Z(Gcode *gcode)
     uint8_t calibrateok = this->calibrate_detected ? 1 : 0;
 
     // print results using the GRBL format
-    gcode->stream->printf("[PRB:%1.3f,%1.3f,%1.3f:%d]\n", THEKERNEL->robot->from_millimeters(pos[X_AXIS]), THEKERNEL->robot->from_millimeters(pos[Y_AXIS]), THEKERNEL->robot->from_millimeters(pos[Z_AXIS]), calibrateok);
+    stream->printf("[PRB:%1.3f,%1.3f,%1.3f:%d]\n", THEKERNEL->robot->from_millimeters(pos[X_AXIS]), THEKERNEL->robot->from_millimeters(pos[Y_AXIS]), THEKERNEL->robot->from_millimeters(pos[Z_AXIS]), calibrateok);
     THEROBOT->set_last_probe_position(std::make_tuple(pos[X_AXIS], pos[Y_AXIS], pos[Z_AXIS], calibrateok));
 
-    if (calibrateok == 0) {
-        // issue error if probe was not triggered and subcode is 2 or 4
-        gcode->stream->printf("ALARM: Calibrate fail!\n");
+    if (calibrateok == 0 && subcode == 6) {
+        // issue error if calibrate was not triggered and subcode is 6
+        stream->printf("ALARM: Calibrate fail!\n");
         THEKERNEL->call_event(ON_HALT, nullptr);
         THEKERNEL->set_halt_reason(CALIBRATE_FAIL);
     }
@@ -588,6 +626,31 @@ void ZProbe::calibrate_Z(Gcode *gcode)
 
 }
 
+// convert actuator steps latched in the step ISR to machine coordinates
+void ZProbe::latch_to_machine(const int32_t steps[], float pos[])
+{
+    ActuatorCoordinates actuator_pos;
+    for (size_t i = X_AXIS; i <= Z_AXIS; i++) {
+        actuator_pos[i] = steps[i] / STEPS_PER_MM(i);
+    }
+    THEROBOT->arm_solution->actuator_to_cartesian(actuator_pos, pos);
+    // the actuators include the compensation transform so get the inverse for the actual machine position
+    if(THEROBOT->compensationTransform) THEROBOT->compensationTransform(pos, true, false);
+}
+
+// stream the points digitized in the step ISR
+void ZProbe::on_idle(void *argument)
+{
+    if(!digitizing) return;
+
+    StepTicker::probe_latch_t latch;
+    while(THEKERNEL->step_ticker->get_digitize_point(latch)) {
+        float pos[3];
+        latch_to_machine(latch.steps, pos);
+        THEKERNEL->streams->printf("[DIG:%1.3f,%1.3f,%1.3f:%d]\n", THEROBOT->from_millimeters(pos[X_AXIS]), THEROBOT->from_millimeters(pos[Y_AXIS]), THEROBOT->from_millimeters(pos[Z_AXIS]), latch.triggered ? 1 : 0);
+    }
+}
+
 // issue a coordinated move directly to robot, and return when done
 // Only move the coordinates that are passed in as not nan
 // NOTE must use G53 to force move in machine coordinates and ignore any WCS offsets
@@ -640,6 +703,18 @@ void ZProbe::home()
     THEKERNEL->call_event(ON_GCODE_RECEIVED, &gc);
 }
 
+void ZProbe::on_set_public_data(void* argument)
+{
+    PublicDataRequest* pdr = static_cast<PublicDataRequest*>(argument);
+
+    if(!pdr->starts_with(zprobe_checksum)) return;
+    if (pdr->second_element_is(straight_probe_checksum)) {
+        const struct zprobe_move *m = static_cast<const struct zprobe_move *>(pdr->get_data_ptr());
+        straight_probe(m->subcode, m->x, m->y, m->z, m->feedrate, THEKERNEL->streams);
+        pdr->set_taken();
+    }
+}
+
 void ZProbe::on_get_public_data(void* argument)
 {
     PublicDataRequest* pdr = static_cast<PublicDataRequest*>(argument);
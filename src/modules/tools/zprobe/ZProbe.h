@@ -26,11 +26,12 @@ class ZProbe: public Module
 {
 
 public:
-    ZProbe() : invert_override(false),invert_probe(false) {};
+    ZProbe() : invert_override(false),invert_probe(false),digitizing(false) {};
     virtual ~ZProbe() {};
 
     void on_module_loaded();
     void on_gcode_received(void *argument);
+    void on_idle(void *argument);
 
     bool run_probe(float& mm, float feedrate, float max_dist= -1, bool reverse= false);
     bool run_probe_return(float& mm, float feedrate, float max_dist= -1, bool reverse= false);
@@ -47,11 +48,14 @@ public:
 
 private:
     void config_load();
-    void probe_XYZ(Gcode *gc);
-    void calibrate_Z(Gcode *gc);
+    void straight_probe(uint8_t subcode, float x, float y, float z, float feedrate, StreamOutput *stream);
+    void probe_XYZ(uint8_t subcode, float x, float y, float z, float rate, StreamOutput *stream);
+    void calibrate_Z(uint8_t subcode, float z, float rate, StreamOutput *stream);
     uint32_t read_probe(uint32_t dummy);
     uint32_t read_calibrate(uint32_t dummy);
+    void latch_to_machine(const int32_t steps[], float pos[]);
     void on_get_public_data(void* argument);
+    void on_set_public_data(void* argument);
 
     float slow_feedrate;
     float fast_feedrate;
@@ -79,6 +83,7 @@ private:
         bool reverse_z:1;
         bool invert_override:1;
         bool invert_probe:1;
+        bool digitizing:1;
     };
 };
 
@@ -5,5 +5,13 @@
 #define zprobe_checksum    CHECKSUM("zprobe")
 #define get_zprobe_pin_states_checksum CHECKSUM("zprobe_pin_states")
 #define get_zprobe_time_checksum CHECKSUM("zprobe_time")
+#define straight_probe_checksum CHECKSUM("straight_probe")
+
+// a G38.x for set_value(zprobe_checksum, straight_probe_checksum), values as the gcode takes them, feedrate nan for the default
+struct zprobe_move {
+    uint8_t subcode;
+    float x, y, z;
+    float feedrate;
+};
 
 #endif
@@ -93,8 +93,8 @@ void MainButton::on_module_loaded()
 
     this->register_for_event(ON_IDLE);
     this->register_for_event(ON_SECOND_TICK);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, main_button_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, main_button_checksum);
 
     // turn on power
     this->switch_power_12(1);
@@ -0,0 +1,216 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GcodeMeta.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+
+GcodeMeta::GcodeMeta(float rapid_rate) : out(NULL), rapid_rate(rapid_rate)
+{
+    memset(&meta, 0, sizeof(meta));
+    meta.version = GCODE_META_VERSION;
+    meta.index_step = GCODE_META_INDEX_STEP;
+    for (int i = 0; i < 4; ++i) {
+        meta.min[i] = FLT_MAX;
+        meta.max[i] = -FLT_MAX;
+        pos[i] = 0;
+    }
+    meta.feed_min = FLT_MAX;
+    meta.feed_max = 0;
+    line_len = 0;
+    offset = line_start = 0;
+    minutes = 0;
+    feed = 0;
+    motion = 0;
+    tool = -1;
+    absolute = true;
+    inches = false;
+    in_comment = false;
+    discard = false;
+}
+
+GcodeMeta::~GcodeMeta()
+{
+    if(out != NULL) fclose(out);
+}
+
+bool GcodeMeta::begin(const char *meta_path)
+{
+    out = fopen(meta_path, "w+");
+    if(out == NULL) return false;
+    // magic stays 0 until finish, an interrupted scan leaves an invalid sidecar
+    return fwrite(&meta, sizeof(meta), 1, out) == 1;
+}
+
+void GcodeMeta::scan(const char *buf, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        char c = buf[i];
+        if(line_len == 0) {
+            line_start = offset;
+            if(meta.lines % meta.index_step == 0) {
+                fwrite(&line_start, sizeof(line_start), 1, out);
+                meta.index_count++;
+            }
+        }
+        offset++;
+        line[line_len++] = c;
+        // fgets ends a line on '\n' or when its buffer is full
+        if(c == '\n' || line_len == GCODE_META_LINE_SIZE - 1) end_line();
+    }
+}
+
+bool GcodeMeta::finish(uint32_t source_size)
+{
+    if(out == NULL) return false;
+    if(line_len > 0) end_line();
+
+    if(meta.feed_min > meta.feed_max) meta.feed_min = meta.feed_max = 0;
+    meta.estimated_secs = lroundf(minutes * 60);
+    meta.source_size = source_size;
+    meta.magic = GCODE_META_MAGIC;
+    bool ok = fseek(out, 0, SEEK_SET) == 0 && fwrite(&meta, sizeof(meta), 1, out) == 1;
+    if(fclose(out) != 0) ok = false;
+    out = NULL;
+    return ok;
+}
+
+void GcodeMeta::end_line()
+{
+    line[line_len] = '\0';
+    // Player discards a line too long for its buffer up to the next '\n', each part still counts as a line
+    if(line[line_len - 1] != '\n') {
+        discard = true;
+    } else if(discard) {
+        discard = false;
+    } else {
+        parse_line();
+    }
+    meta.lines++;
+    line_len = 0;
+}
+
+void GcodeMeta::parse_line()
+{
+    float target[4];
+    memcpy(target, pos, sizeof(target));
+    float ij[2] = {0, 0};
+    bool has_axis = false;
+    bool machine_coords = false;
+    bool tool_change = false;
+    float scale = inches ? 25.4F : 1.0F;
+
+    const char *p = line;
+    while (*p != '\0') {
+        char c = *p++;
+        if(in_comment) {
+            if(c == ')') in_comment = false;
+            continue;
+        }
+        if(c == '(') { in_comment = true; continue; }
+        if(c == ';') break;
+        if(c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if(c < 'A' || c > 'Z') continue;
+
+        char *end;
+        float v = strtof(p, &end);
+        if(end == p) continue;
+        p = end;
+
+        switch (c) {
+            case 'G':
+                switch ((int)v) {
+                    case 0: case 1: case 2: case 3: motion = (uint8_t)v; break;
+                    case 20: inches = true; scale = 25.4F; break;
+                    case 21: inches = false; scale = 1.0F; break;
+                    case 53: machine_coords = true; break;
+                    case 90: absolute = true; break;
+                    case 91: absolute = false; break;
+                }
+                break;
+            case 'M': if((int)v == 6) tool_change = true; break;
+            case 'T': tool = (int)v; break;
+            case 'F':
+                if(v > 0) {
+                    feed = v * scale;
+                    if(feed < meta.feed_min) meta.feed_min = feed;
+                    if(feed > meta.feed_max) meta.feed_max = feed;
+                }
+                break;
+            case 'X': case 'Y': case 'Z': case 'A': {
+                int a = (c == 'A') ? 3 : c - 'X';
+                float d = (c == 'A') ? v : v * scale;
+                target[a] = absolute ? d : pos[a] + d;
+                has_axis = true;
+                break;
+            }
+            case 'I': ij[0] = v * scale; break;
+            case 'J': ij[1] = v * scale; break;
+        }
+    }
+    // comments do not span lines
+    in_comment = false;
+
+    if(tool_change && tool >= 0 && tool < 64) meta.tools |= (uint64_t)1 << tool;
+    // a G53 move ends at a machine position the work coordinates of which are not known here
+    if(!has_axis || machine_coords) return;
+
+    float dx = target[0] - pos[0], dy = target[1] - pos[1], dz = target[2] - pos[2];
+    float len;
+    if(motion >= 2 && (ij[0] != 0 || ij[1] != 0)) {
+        // arc in the XY plane around pos + ij
+        float r = hypotf(ij[0], ij[1]);
+        float a0 = atan2f(-ij[1], -ij[0]);
+        float a1 = atan2f(target[1] - pos[1] - ij[1], target[0] - pos[0] - ij[0]);
+        float sweep = (motion == 2) ? a0 - a1 : a1 - a0;
+        if(sweep <= 0) sweep += 2 * (float)M_PI;
+        len = hypotf(r * sweep, dz);
+    } else {
+        len = sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+    // rotary only moves are timed by their degrees
+    if(len == 0) len = fabsf(target[3] - pos[3]);
+
+    float rate = (motion == 0) ? rapid_rate : feed;
+    if(rate > 0) minutes += len / rate;
+
+    for (int i = 0; i < 4; ++i) {
+        if(target[i] < meta.min[i]) meta.min[i] = target[i];
+        if(target[i] > meta.max[i]) meta.max[i] = target[i];
+    }
+    memcpy(pos, target, sizeof(pos));
+}
+
+bool GcodeMeta::read_header(const char *meta_path, gcode_meta_t& header)
+{
+    FILE *f = fopen(meta_path, "r");
+    if(f == NULL) return false;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1;
+    fclose(f);
+    return ok && header.magic == GCODE_META_MAGIC && header.version == GCODE_META_VERSION;
+}
+
+bool GcodeMeta::find_line(const char *meta_path, uint32_t source_size, uint32_t& line, uint32_t& offset)
+{
+    FILE *f = fopen(meta_path, "r");
+    if(f == NULL) return false;
+
+    gcode_meta_t header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == GCODE_META_MAGIC &&
+              header.version == GCODE_META_VERSION && header.source_size == source_size && header.index_count > 0;
+    if(ok) {
+        uint32_t k = line > 0 ? (line - 1) / header.index_step : 0;
+        if(k >= header.index_count) k = header.index_count - 1;
+        ok = fseek(f, sizeof(header) + k * sizeof(uint32_t), SEEK_SET) == 0 && fread(&offset, sizeof(offset), 1, f) == 1;
+        line = k * header.index_step;
+    }
+    fclose(f);
+    return ok;
+}
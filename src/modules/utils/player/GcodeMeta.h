@@ -0,0 +1,80 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define GCODE_META_MAGIC      0x4154454D // "META"
+#define GCODE_META_VERSION    1
+#define GCODE_META_INDEX_STEP 1000
+#define GCODE_META_LINE_SIZE  130        // the same line buffer Player reads with
+
+// Header of the binary sidecar in /sd/gcodes/.meta, followed by index_count uint32_t file offsets,
+// entry k is the offset of line k * index_step + 1
+// Lines are counted the way Player::goto_command counts them, so the index can replace its scan
+struct gcode_meta_t {
+    uint32_t magic;           // only written once the scan is complete
+    uint16_t version;
+    uint16_t index_step;
+    uint32_t source_size;     // size of the file described, anything else means the sidecar is stale
+    uint32_t lines;
+    uint32_t index_count;
+    uint32_t estimated_secs;  // path length over programmed feed, rapids at the seek rate, acceleration ignored
+    uint64_t tools;           // bit n set if tool n is changed to, tools above 63 are not recorded
+    float min[4];             // XYZA bounds of the programmed end points, min > max if there were no moves
+    float max[4];
+    float feed_min;
+    float feed_max;
+} __attribute__((packed));
+
+// Scans a gcode file once and writes its sidecar, fed in chunks so it can run a little at a time
+class GcodeMeta {
+    public:
+        GcodeMeta(float rapid_rate);
+        ~GcodeMeta();
+
+        // opens the sidecar and writes an incomplete header
+        bool begin(const char *meta_path);
+        void scan(const char *buf, size_t n);
+        // completes the header, the sidecar is only valid after this
+        bool finish(uint32_t source_size);
+
+        const gcode_meta_t& get_meta() const { return meta; }
+
+        static bool read_header(const char *meta_path, gcode_meta_t& header);
+        // offset of the last indexed line at or before line, sets line to the number of lines before it,
+        // false if there is no sidecar or it does not match the file
+        static bool find_line(const char *meta_path, uint32_t source_size, uint32_t& line, uint32_t& offset);
+
+    private:
+        void end_line();
+        void parse_line();
+
+        FILE *out;
+        gcode_meta_t meta;
+        char line[GCODE_META_LINE_SIZE];
+        size_t line_len;
+        uint32_t offset;          // bytes scanned so far
+        uint32_t line_start;
+        float rapid_rate;
+        float minutes;
+
+        // modal state
+        float pos[4];
+        float feed;
+        uint8_t motion;
+        int tool;
+        struct {
+            bool absolute:1;
+            bool inches:1;
+            bool in_comment:1;
+            bool discard:1;
+        };
+};
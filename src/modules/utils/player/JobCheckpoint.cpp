@@ -0,0 +1,102 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "JobCheckpoint.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+bool JobCheckpoint::open()
+{
+    if(f != NULL) return true;
+
+    job_checkpoint_t last;
+    seq = read_latest(path, last) ? last.seq + 1 : 0;
+
+    slot = static_cast<char *>(malloc(JOB_CHECKPOINT_SLOT_SIZE));
+    if(slot == nullptr) return false;
+    memset(slot, 0, JOB_CHECKPOINT_SLOT_SIZE);
+
+    const long size = JOB_CHECKPOINT_SLOTS * JOB_CHECKPOINT_SLOT_SIZE;
+    f = fopen(path.c_str(), "r+");
+    if(f != NULL && (fseek(f, 0, SEEK_END) != 0 || ftell(f) != size)) {
+        fclose(f);
+        f = NULL;
+    }
+    if(f == NULL) {
+        f = fopen(path.c_str(), "w+");
+        if(f == NULL) {
+            close();
+            return false;
+        }
+        for (int i = 0; i < JOB_CHECKPOINT_SLOTS; ++i) {
+            if(fwrite(slot, JOB_CHECKPOINT_SLOT_SIZE, 1, f) != 1) {
+                close();
+                return false;
+            }
+        }
+        fflush(f);
+    }
+    // whole sector writes with no stdio buffer go straight to the card
+    setvbuf(f, NULL, _IONBF, 0);
+    return true;
+}
+
+bool JobCheckpoint::write(job_checkpoint_t& cp)
+{
+    if(f == NULL) return false;
+
+    cp.magic = JOB_CHECKPOINT_MAGIC;
+    cp.seq = seq;
+    cp.check = checksum(cp);
+    memcpy(slot, &cp, sizeof(cp));
+    bool ok = fseek(f, (seq % JOB_CHECKPOINT_SLOTS) * JOB_CHECKPOINT_SLOT_SIZE, SEEK_SET) == 0 &&
+              fwrite(slot, JOB_CHECKPOINT_SLOT_SIZE, 1, f) == 1;
+    seq++;
+    return ok;
+}
+
+void JobCheckpoint::close()
+{
+    if(f != NULL) {
+        fclose(f);
+        f = NULL;
+    }
+    free(slot);
+    slot = nullptr;
+}
+
+bool JobCheckpoint::read_latest(const std::string& path, job_checkpoint_t& cp)
+{
+    FILE *fp = fopen(path.c_str(), "r");
+    if(fp == NULL) return false;
+
+    bool found = false;
+    job_checkpoint_t c;
+    for (int i = 0; i < JOB_CHECKPOINT_SLOTS; ++i) {
+        if(fseek(fp, i * JOB_CHECKPOINT_SLOT_SIZE, SEEK_SET) != 0 || fread(&c, sizeof(c), 1, fp) != 1) break;
+        // a slot torn by a power cut fails the check and the one before it is used
+        if(c.magic != JOB_CHECKPOINT_MAGIC || c.check != checksum(c)) continue;
+        if(!found || c.seq > cp.seq) {
+            cp = c;
+            found = true;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+uint32_t JobCheckpoint::checksum(const job_checkpoint_t& cp)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&cp);
+    uint32_t h = 2166136261UL;
+    for (size_t i = 0; i < offsetof(job_checkpoint_t, check); ++i) {
+        h = (h ^ p[i]) * 16777619UL;
+    }
+    return h;
+}
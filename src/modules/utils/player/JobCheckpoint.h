@@ -0,0 +1,65 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+#define JOB_CHECKPOINT_MAGIC     0x54504B43 // "CKPT"
+#define JOB_CHECKPOINT_SLOTS     8
+#define JOB_CHECKPOINT_SLOT_SIZE 512        // one sector, so a checkpoint is a single sector write
+
+#define CHECKPOINT_ABSOLUTE   0x01
+#define CHECKPOINT_INCHES     0x02
+#define CHECKPOINT_SPINDLE_ON 0x04
+
+// State needed to carry on with a job from the first line that had not been executed
+struct job_checkpoint_t {
+    uint32_t magic;
+    uint32_t seq;           // written to slot seq % JOB_CHECKPOINT_SLOTS, the valid slot with the highest seq is the latest
+    uint8_t active;         // cleared when the job ends, there is nothing to resume
+    uint8_t wcs;            // 0 is G54
+    uint8_t flags;
+    uint8_t motion;         // 0 - 3 for G0 - G3
+    char filename[128];
+    uint32_t file_size;     // to tell if the file was changed since
+    uint32_t offset;        // file offset of the line to resume from
+    uint32_t line;          // its line number, counted from 1
+    uint32_t elapsed_secs;
+    int32_t tool;
+    float feed;             // mm/min
+    float spindle_rpm;
+    float mpos[4];          // machine XYZA position when the checkpoint was taken
+    uint32_t check;         // FNV-1a of everything before it
+} __attribute__((packed));
+
+// Keeps checkpoints in a file of fixed size slots which are written round robin,
+// the file is created at full size so a checkpoint never changes the FAT or the directory entry
+class JobCheckpoint {
+    public:
+        JobCheckpoint(const std::string& path) : path(path), f(NULL), slot(nullptr), seq(0) {}
+        ~JobCheckpoint() { close(); }
+
+        bool open();
+        // fills in magic, seq and check before writing
+        bool write(job_checkpoint_t& cp);
+        void close();
+        const std::string& get_path() const { return path; }
+
+        // latest valid checkpoint in the file, false if there is none
+        static bool read_latest(const std::string& path, job_checkpoint_t& cp);
+
+    private:
+        static uint32_t checksum(const job_checkpoint_t& cp);
+
+        std::string path;
+        FILE *f;
+        char *slot;
+        uint32_t seq;
+};
@@ -0,0 +1,69 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "JobLog.h"
+#include "AppendFileStream.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#define JOB_LOG_BUFFER_SIZE 512
+
+JobLog::JobLog(const std::string& path, uint32_t max_size, uint32_t line_interval, uint32_t flush_ms)
+    : path(path), max_size(max_size), line_interval(line_interval), flush_ms(flush_ms)
+{
+    file_size = 0;
+    FILE *f = fopen(path.c_str(), "r");
+    if(f != NULL) {
+        if(fseek(f, 0, SEEK_END) == 0) file_size = ftell(f);
+        fclose(f);
+    }
+    out = new AppendFileStream(path.c_str(), JOB_LOG_BUFFER_SIZE);
+}
+
+JobLog::~JobLog()
+{
+    delete out;
+}
+
+void JobLog::event(uint32_t secs, const char *format, ...)
+{
+    char b[96];
+    int n = snprintf(b, sizeof(b), "%lu ", secs);
+    va_list args;
+    va_start(args, format);
+    n += vsnprintf(b + n, sizeof(b) - n - 1, format, args);
+    va_end(args);
+    if(n > (int)sizeof(b) - 2) n = sizeof(b) - 2;
+    b[n++] = '\n';
+    out->puts(b, n);
+}
+
+void JobLog::poll()
+{
+    if(out->pending() == 0) return;
+    out->flush_if_due(flush_ms);
+    if(out->pending() == 0) rotate();
+}
+
+void JobLog::sync()
+{
+    out->flush();
+    rotate();
+}
+
+void JobLog::rotate()
+{
+    if(max_size == 0 || file_size + out->get_written() < max_size) return;
+
+    delete out;
+    std::string old = path + ".1";
+    remove(old.c_str());
+    rename(path.c_str(), old.c_str());
+    file_size = 0;
+    out = new AppendFileStream(path.c_str(), JOB_LOG_BUFFER_SIZE);
+}
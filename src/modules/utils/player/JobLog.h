@@ -0,0 +1,41 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+class AppendFileStream;
+
+// Text log of what happened while playing files, one "<elapsed secs> <event>" line per entry
+// Entries are buffered and written from the main loop, when the file grows past max_size it is renamed to <file>.1 and a new one started
+class JobLog {
+    public:
+        JobLog(const std::string& path, uint32_t max_size, uint32_t line_interval, uint32_t flush_ms);
+        ~JobLog();
+
+        void event(uint32_t secs, const char *format, ...) __attribute__ ((format(printf, 3, 4)));
+        // records every line_interval'th line played
+        void line(uint32_t secs, uint32_t line) { if(line_interval > 0 && line % line_interval == 0) event(secs, "L %lu", line); }
+
+        // called every main loop, writes out entries that have waited flush_ms
+        void poll();
+        // writes everything now, used when a job ends
+        void sync();
+
+    private:
+        void rotate();
+
+        std::string path;
+        AppendFileStream *out;
+        uint32_t max_size;
+        uint32_t line_interval;
+        uint32_t flush_ms;
+        uint32_t file_size;     // size of the file when out was opened
+};
@@ -33,6 +33,11 @@
 #include "StepTicker.h"
 #include "Block.h"
 #include "quicklz.h"
+#include "GcodeMeta.h"
+#include "JobLog.h"
+#include "JobCheckpoint.h"
+#include "SpindlePublicAccess.h"
+#include "platform_memory.h"
 
 #include <math.h>
 
@@ -49,11 +54,24 @@
 #define before_resume_gcode_checksum      CHECKSUM("before_resume_gcode")
 #define leave_heaters_on_suspend_checksum CHECKSUM("leave_heaters_on_suspend")
 #define laser_module_clustering_checksum 	  CHECKSUM("laser_module_clustering")
+#define job_log_enable_checksum           CHECKSUM("job_log_enable")
+#define job_log_file_checksum             CHECKSUM("job_log_file")
+#define job_log_max_size_checksum         CHECKSUM("job_log_max_size")
+#define job_log_line_interval_checksum    CHECKSUM("job_log_line_interval")
+#define job_log_flush_ms_checksum         CHECKSUM("job_log_flush_ms")
+#define checkpoint_enable_checksum        CHECKSUM("checkpoint_enable")
+#define checkpoint_file_checksum          CHECKSUM("checkpoint_file")
+#define checkpoint_interval_checksum      CHECKSUM("checkpoint_interval")
+
+// lines remembered per planner queue block, a line can be fed without queueing a block
+#define PLAYER_FED_LINES_PER_BLOCK 2
 
 extern SDFAT mounter;
 
 unsigned char xbuff[8200] __attribute__((section("AHBSRAM1"))); /* 2 for data length, 8192 for XModem + 3 head chars + 2 crc + nul */
 static unsigned char fbuff[4096] __attribute__((section("AHBSRAM1")));
+// cluster link map of the file being played, 2 entries per fragment plus 2
+static DWORD clmt[128] __attribute__((section("AHBSRAM1")));
 // used for XMODEM
 #define SOH  0x01
 #define STX  0x02
@@ -76,6 +94,18 @@ Player::Player()
     this->reply_stream = nullptr;
     this->inner_playing = false;
     this->slope = 0.0;
+    this->meta_scan = nullptr;
+    this->meta_source = nullptr;
+    this->meta_source_size = 0;
+    this->job_log = nullptr;
+    this->checkpoint = nullptr;
+    this->fed_lines = nullptr;
+    this->fed_head = 0;
+    this->fed_count = 0;
+    this->fed_size = 0;
+    this->checkpoint_interval = 0;
+    this->checkpoint_countdown = 0;
+    this->checkpoint_due = false;
 }
 
 void Player::on_module_loaded()
@@ -83,9 +113,12 @@ void Player::on_module_loaded()
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_SECOND_TICK);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
-    this->register_for_event(ON_GCODE_RECEIVED);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, player_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, player_checksum);
+    for (uint16_t m : {1, 21, 23, 24, 25, 26, 27, 32, 118, 600, 601}) {
+        this->register_for_gcode('M', m);
+    }
+    this->register_for_gcode('G', 28);
     this->register_for_event(ON_HALT);
 
     this->on_boot_gcode = THEKERNEL->config->value(on_boot_gcode_checksum)->by_default("/sd/on_boot.gcode")->as_string();
@@ -100,6 +133,29 @@ void Player::on_module_loaded()
     this->leave_heaters_on = THEKERNEL->config->value(leave_heaters_on_suspend_checksum)->by_default(false)->as_bool();
 
     this->laser_clustering = THEKERNEL->config->value(laser_module_clustering_checksum)->by_default(false)->as_bool();
+
+    if(THEKERNEL->config->value(job_log_enable_checksum)->by_default(false)->as_bool()) {
+        this->job_log = new JobLog(THEKERNEL->config->value(job_log_file_checksum)->by_default("/sd/job.log")->as_string(),
+                                   THEKERNEL->config->value(job_log_max_size_checksum)->by_default(32768)->as_int(),
+                                   THEKERNEL->config->value(job_log_line_interval_checksum)->by_default(100)->as_int(),
+                                   THEKERNEL->config->value(job_log_flush_ms_checksum)->by_default(2000)->as_int());
+    }
+
+    if(THEKERNEL->config->value(checkpoint_enable_checksum)->by_default(false)->as_bool()) {
+        // enough to cover every line the planner queue can hold, more than fed_head can index is not kept
+        size_t lines = THECONVEYOR->get_queue_size() * PLAYER_FED_LINES_PER_BLOCK;
+        if(lines > 255) lines = 255;
+        size_t n = lines * sizeof(fed_line_t);
+        void *v = AHB0.alloc(n);
+        if(v == nullptr) v = malloc(n);
+        if(v != nullptr) {
+            this->fed_lines = static_cast<fed_line_t *>(v);
+            this->fed_size = lines;
+            this->checkpoint = new JobCheckpoint(THEKERNEL->config->value(checkpoint_file_checksum)->by_default("/sd/.checkpoint")->as_string());
+            this->checkpoint_interval = THEKERNEL->config->value(checkpoint_interval_checksum)->by_default(10)->as_int();
+            if(this->checkpoint_interval == 0) this->checkpoint_interval = 1;
+        }
+    }
 }
 
 void Player::on_halt(void* argument)
@@ -107,6 +163,7 @@ void Player::on_halt(void* argument)
     this->clear_buffered_queue();
 
     if(argument == nullptr && this->playing_file ) {
+        if(this->job_log != nullptr) this->job_log->event(this->elapsed_secs, "halt line %lu", this->played_lines);
         abort_command("1", &(StreamOutput::NullStream));
 	}
 
@@ -121,7 +178,23 @@ void Player::on_halt(void* argument)
 
 void Player::on_second_tick(void *)
 {
-    if(this->playing_file) this->elapsed_secs++;
+    if(this->playing_file) {
+        this->elapsed_secs++;
+        if(this->checkpoint != nullptr && --this->checkpoint_countdown == 0) {
+            this->checkpoint_due = true;
+            this->checkpoint_countdown = this->checkpoint_interval;
+        }
+    }
+}
+
+// files that are played get a cluster link map so goto, resume and restart seek without walking the FAT chain
+FILE *Player::open_for_play(const string& fn)
+{
+    mbed::FATFileSystem::fast_seek_next_open(clmt, sizeof(clmt) / sizeof(clmt[0]));
+    FILE *f = fopen(fn.c_str(), "r");
+    // not taken if the open failed or the file is not on the sd card
+    mbed::FATFileSystem::fast_seek_next_open(NULL, 0);
+    return f;
 }
 
 // extract any options found on line, terminates args at the space before the first option (-v)
@@ -162,7 +235,7 @@ void Player::on_gcode_received(void *argument)
                 this->playing_file = false;
                 fclose(this->current_file_handler);
             }
-            this->current_file_handler = fopen( this->filename.c_str(), "r");
+            this->current_file_handler = open_for_play(this->filename);
 
             if(this->current_file_handler == NULL) {
                 gcode->stream->printf("file.open failed: %s\r\n", this->filename.c_str());
@@ -191,6 +264,8 @@ void Player::on_gcode_received(void *argument)
         } else if (gcode->m == 24) { // start print
             if (this->current_file_handler != NULL) {
                 this->playing_file = true;
+                if(this->job_log != nullptr) this->job_log->event(this->elapsed_secs, "play %s line %lu", this->filename.c_str(), this->played_lines);
+                start_checkpoints();
                 // this would be a problem if the stream goes away before the file has finished,
                 // so we attach it to the kernel stream, however network connections from pronterface
                 // do not connect to the kernel streams so won't see this FIXME
@@ -198,6 +273,7 @@ void Player::on_gcode_received(void *argument)
             }
 
         } else if (gcode->m == 25) { // pause print
+            if(this->playing_file && this->job_log != nullptr) this->job_log->event(this->elapsed_secs, "pause line %lu", this->played_lines);
             this->playing_file = false;
 
         } else if (gcode->m == 26) { // Reset print. Slightly different than M26 in Marlin and the rest
@@ -210,7 +286,7 @@ void Player::on_gcode_received(void *argument)
 
                 if(!currentfn.empty()) {
                     // reload the last file opened
-                    this->current_file_handler = fopen(currentfn.c_str() , "r");
+                    this->current_file_handler = open_for_play(currentfn);
 
                     if(this->current_file_handler == NULL) {
                         gcode->stream->printf("file.open failed: %s\r\n", currentfn.c_str());
@@ -237,11 +313,13 @@ void Player::on_gcode_received(void *argument)
                 fclose(this->current_file_handler);
             }
 
-            this->current_file_handler = fopen( this->filename.c_str(), "r");
+            this->current_file_handler = open_for_play(this->filename);
             if(this->current_file_handler == NULL) {
                 gcode->stream->printf("file.open failed: %s\r\n", this->filename.c_str());
             } else {
                 this->playing_file = true;
+                if(this->job_log != nullptr) this->job_log->event(0, "play %s", this->filename.c_str());
+                start_checkpoints();
 
                 // get size of file
                 int result = fseek(this->current_file_handler, 0, SEEK_END);
@@ -315,6 +393,10 @@ void Player::on_console_line_received( void *argument )
     	this->buffer_command( possible_command, new_message.stream );
     }else if (cmd == "upload") {
     	this->upload_command( possible_command, new_message.stream );
+    }else if (cmd == "meta") {
+        this->meta_command( possible_command, new_message.stream );
+    }else if (cmd == "checkpoint") {
+        this->checkpoint_command( possible_command, new_message.stream );
     }else if (cmd == "download") {
         memset(md5_str, 0, sizeof(md5_str));
     	if (possible_command.find("config.txt") != string::npos) {
@@ -370,7 +452,7 @@ void Player::play_command( string parameters, StreamOutput *stream )
 //    }
 
 
-    this->current_file_handler = fopen( this->filename.c_str(), "r");
+    this->current_file_handler = open_for_play(this->filename);
     if(this->current_file_handler == NULL) {
         stream->printf("File not found: %s\r\n", this->filename.c_str());
         return;
@@ -379,6 +461,8 @@ void Player::play_command( string parameters, StreamOutput *stream )
     stream->printf("Playing %s\r\n", this->filename.c_str());
 
     this->playing_file = true;
+    if(this->job_log != nullptr) this->job_log->event(0, "play %s", this->filename.c_str());
+    start_checkpoints();
 
     // Output to the current stream if we were passed the -v ( verbose ) option
     if( options.find_first_of("Vv") == string::npos ) {
@@ -434,10 +518,16 @@ void Player::goto_command( string parameters, StreamOutput *stream )
         // goto line
         char buf[130]; // lines upto 128 characters are allowed, anything longer is discarded
 
-        // goto file begin
-        fseek(this->current_file_handler, 0, SEEK_SET);
-        played_lines = 0;
-        played_cnt   = 0;
+        // start from the closest indexed line before it if the file has a sidecar, else from the beginning
+        uint32_t line = this->goto_line, offset = 0;
+        if (!GcodeMeta::find_line(change_to_meta_path(this->filename).c_str(), this->file_size, line, offset)) {
+            line = offset = 0;
+        }
+        fseek(this->current_file_handler, offset, SEEK_SET);
+        played_lines = line;
+        played_cnt   = offset;
+        // the lines fed before the jump are not where the job continues from
+        fed_count = 0;
 
         while (fgets(buf, sizeof(buf), this->current_file_handler) != NULL) {
         	if (played_lines % 100 == 0) {
@@ -506,6 +596,13 @@ void Player::abort_command( string parameters, StreamOutput *stream )
         return;
     }
 
+    if(this->job_log != nullptr) {
+        this->job_log->event(this->elapsed_secs, "abort line %lu", this->played_lines);
+        this->job_log->sync();
+    }
+    // a halt leaves the last checkpoint in place so the job can be resumed once the alarm is cleared
+    end_checkpoints(THEKERNEL->is_halted());
+
     this->playing_file = false;
     this->played_cnt = 0;
     this->played_lines = 0;
@@ -577,11 +674,27 @@ void Player::on_main_loop(void *argument)
 
     }
 
+    if (this->meta_scan != nullptr && !this->playing_file) {
+        scan_meta();
+    }
+
+    if (this->job_log != nullptr) {
+        this->job_log->poll();
+    }
+
+    // lets the conveyor tell a starved planner from a paused job
+    THECONVEYOR->set_job_active(this->playing_file && !THEKERNEL->is_halted() && !THEKERNEL->is_suspending() && !THEKERNEL->is_waiting());
+
     if ( this->playing_file ) {
         if(THEKERNEL->is_halted() || THEKERNEL->is_suspending() || THEKERNEL->is_waiting() || this->inner_playing) {
             return;
         }
 
+        if (this->checkpoint_due) {
+            this->checkpoint_due = false;
+            take_checkpoint();
+        }
+
         // check if there are bufferd command
         while (!this->buffered_queue.empty()) {
         	THEKERNEL->streams->printf("%s\r\n", this->buffered_queue.front().c_str());
@@ -699,6 +812,8 @@ void Player::on_main_loop(void *argument)
                     this->current_stream->printf("%s", buf);
                 }
 
+                if (this->fed_lines != nullptr) record_fed_line(len);
+
                 struct SerialMessage message;
                 message.message = buf;
                 message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
@@ -711,6 +826,7 @@ void Player::on_main_loop(void *argument)
                 // THEKERNEL->streams->printf("0-[Line: %d] %s\n", message.line, buf);
                 played_lines += 1;
                 played_cnt += len;
+                if(this->job_log != nullptr) this->job_log->line(this->elapsed_secs, played_lines);
                 return; // we feed one line per main loop
 
             } else {
@@ -720,6 +836,12 @@ void Player::on_main_loop(void *argument)
             }
         }
 
+        if(this->job_log != nullptr) {
+            this->job_log->event(this->elapsed_secs, "done %s lines %lu", this->filename.c_str(), played_lines);
+            this->job_log->sync();
+        }
+        end_checkpoints(false);
+
         this->playing_file = false;
         this->filename = "";
         played_cnt = 0;
@@ -809,6 +931,11 @@ void Player::on_get_public_data(void *argument)
     	bool b = this->inner_playing;
         pdr->set_data_ptr(&b);
         pdr->set_taken();
+
+    } else if (pdr->second_element_is(file_in_use_checksum)) {
+        struct pad_file_in_use *f = static_cast<struct pad_file_in_use *>(pdr->get_data_ptr());
+        f->in_use = this->current_file_handler != NULL && (f->filename == this->filename || f->filename == this->last_filename);
+        pdr->set_taken();
     }
 }
 
@@ -830,6 +957,16 @@ void Player::on_set_public_data(void *argument)
     		THEKERNEL->streams->printf("Job restarted: %s.\r\n", this->last_filename.c_str());
         	this->play_command(this->last_filename, &(StreamOutput::NullStream));
     	}
+    } else if (pdr->second_element_is(scan_meta_checksum)) {
+        // a file stored by some other path than the upload command
+        start_meta_scan(*static_cast<string *>(pdr->get_data_ptr()));
+        pdr->set_taken();
+    } else if (pdr->second_element_is(stop_meta_scan_checksum)) {
+        // the file or its sidecar is about to be removed or renamed, taken only if a scan of it was stopped
+        if (this->meta_scan != nullptr && this->meta_source_name == *static_cast<string *>(pdr->get_data_ptr())) {
+            stop_meta_scan();
+            pdr->set_taken();
+        }
     }
 }
 
@@ -885,6 +1022,9 @@ void Player::suspend_command(string parameters, StreamOutput *stream )
     THEROBOT->push_state();
     current_motion_mode = THEROBOT->get_current_motion_mode();
 
+    // the queue is empty so this is exactly where the job stopped, taken before after_suspend_gcode parks it
+    take_checkpoint();
+
     // execute optional gcode if defined
     if(!after_suspend_gcode.empty()) {
         struct SerialMessage message;
@@ -894,6 +1034,7 @@ void Player::suspend_command(string parameters, StreamOutput *stream )
         THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
     }
 
+    if(this->job_log != nullptr) this->job_log->event(this->elapsed_secs, "suspend line %lu", this->played_lines);
     THEKERNEL->streams->printf("Suspended, resume to continue playing\n");
 }
 
@@ -961,6 +1102,7 @@ void Player::resume_command(string parameters, StreamOutput *stream )
     }
 
 	THEKERNEL->set_suspending(false);
+	if(this->job_log != nullptr) this->job_log->event(this->elapsed_secs, "resume line %lu", this->played_lines);
 
 	stream->printf("Playing file resumed\n");
 }
@@ -1250,6 +1392,8 @@ void Player::upload_command( string parameters, StreamOutput *stream )
     string lzfilename = change_to_lz_path(filename);
     check_and_make_path(md5_filename);
     check_and_make_path(lzfilename);
+    // the file may be the one still being scanned
+    stop_meta_scan();
 
 	// diasble serial rx irq in case of serial stream, and internal process in case of wifi
     if (stream->type() == 0) {
@@ -1418,6 +1562,7 @@ upload_error:
 		fd_md5 = NULL;
 		remove(md5_filename.c_str());
 	}
+	mounter.dir_changed();
 	flush_input(stream);
     if (stream->type() == 0) {
     	set_serial_rx_irq(true);
@@ -1447,6 +1592,7 @@ upload_success:
 		if(!decompress(srcfilename,desfilename,u32filesize,stream))
 			goto upload_error;
     }
+	mounter.dir_changed();
 
 	// renable TIME0 and TIME1
 	NVIC_EnableIRQ(TIMER0_IRQn);     // Enable interrupt handler
@@ -1455,6 +1601,323 @@ upload_success:
     	set_serial_rx_irq(true);
     }
 	stream->printf("Info: upload success: %s.\r\n", desfilename.c_str());
+
+	if (desfilename.find("firmware.bin") == string::npos) {
+		start_meta_scan(desfilename);
+	}
+}
+
+void Player::start_meta_scan(const string& fn)
+{
+    stop_meta_scan();
+    meta_source = fopen(fn.c_str(), "r");
+    if (meta_source == NULL) return;
+    fseek(meta_source, 0, SEEK_END);
+    meta_source_size = ftell(meta_source);
+    fseek(meta_source, 0, SEEK_SET);
+
+    meta_source_name = fn;
+
+    string meta_path = change_to_meta_path(fn);
+    check_and_make_path(meta_path);
+    meta_scan = new GcodeMeta(THEROBOT->get_seek_rate());
+    if (!meta_scan->begin(meta_path.c_str())) {
+        stop_meta_scan();
+    }
+}
+
+void Player::stop_meta_scan()
+{
+    // an unfinished sidecar is left without its magic and is never used
+    delete meta_scan;
+    meta_scan = nullptr;
+    if (meta_source != NULL) {
+        fclose(meta_source);
+        meta_source = NULL;
+    }
+    meta_source_name.clear();
+}
+
+void Player::scan_meta()
+{
+    char buf[256];
+    size_t n = fread(buf, 1, sizeof(buf), meta_source);
+    if (n > 0) {
+        meta_scan->scan(buf, n);
+        return;
+    }
+    meta_scan->finish(meta_source_size);
+    stop_meta_scan();
+}
+
+// prints the sidecar of a gcode file, meta <file>
+void Player::meta_command( string parameters, StreamOutput *stream )
+{
+    string fn = absolute_from_relative(shift_parameter(parameters));
+    gcode_meta_t m;
+    if (!GcodeMeta::read_header(change_to_meta_path(fn).c_str(), m)) {
+        stream->printf("No metadata for %s\r\n", fn.c_str());
+        return;
+    }
+
+    stream->printf("lines: %lu\r\n", m.lines);
+    stream->printf("size: %lu\r\n", m.source_size);
+    stream->printf("estimated time: %02lu:%02lu:%02lu\r\n", m.estimated_secs / 3600, (m.estimated_secs % 3600) / 60, m.estimated_secs % 60);
+    if (m.min[0] <= m.max[0]) {
+        stream->printf("bounds: X%.3f:%.3f Y%.3f:%.3f Z%.3f:%.3f A%.3f:%.3f\r\n",
+            m.min[0], m.max[0], m.min[1], m.max[1], m.min[2], m.max[2], m.min[3], m.max[3]);
+    }
+    stream->printf("feed: %.1f:%.1f\r\n", m.feed_min, m.feed_max);
+    stream->printf("tools:");
+    for (int t = 0; t < 64; ++t) {
+        if (m.tools & ((uint64_t)1 << t)) stream->printf(" %d", t);
+    }
+    stream->printf("\r\n");
+}
+
+
+void Player::start_checkpoints()
+{
+    if (this->checkpoint == nullptr) return;
+
+    this->fed_count = 0;
+    this->checkpoint_due = false;
+    this->checkpoint_countdown = this->checkpoint_interval;
+    if (!this->checkpoint->open()) {
+        THEKERNEL->streams->printf("WARNING: can not open checkpoint file %s\n", this->checkpoint->get_path().c_str());
+    }
+}
+
+void Player::end_checkpoints(bool keep)
+{
+    if (this->checkpoint == nullptr) return;
+
+    this->checkpoint_due = false;
+    if (!keep) {
+        // an inactive record supersedes the last checkpoint so there is nothing left to resume
+        job_checkpoint_t cp;
+        memset(&cp, 0, sizeof(cp));
+        this->checkpoint->write(cp);
+    }
+    this->checkpoint->close();
+}
+
+void Player::save_state(fed_line_t& f, uint32_t line, uint32_t offset)
+{
+    f.line = line;
+    f.offset = offset;
+    f.feed = THEROBOT->get_programmed_feed_rate();
+    THEROBOT->get_axis_position(f.pos, 4);
+    f.wcs = THEROBOT->get_current_wcs();
+    f.flags = (THEROBOT->absolute_mode ? CHECKPOINT_ABSOLUTE : 0) | (THEROBOT->inch_mode ? CHECKPOINT_INCHES : 0);
+    f.motion = THEROBOT->get_current_motion_mode();
+}
+
+// called before a line is fed, so the state saved is the one the line starts from
+void Player::record_fed_line(size_t len)
+{
+    save_state(this->fed_lines[this->fed_head], this->played_lines + 1, ftell(this->current_file_handler) - len);
+    this->fed_head = (this->fed_head + 1) % this->fed_size;
+    if (this->fed_count < this->fed_size) this->fed_count++;
+}
+
+void Player::take_checkpoint()
+{
+    if (this->checkpoint == nullptr || this->current_file_handler == NULL) return;
+
+    // resume from the line the executing block came from, or from the next line to be read once the queue has run dry
+    const fed_line_t *e = nullptr;
+    if (!THECONVEYOR->is_queue_empty()) {
+        const Block *block = StepTicker::getInstance()->get_current_block();
+        unsigned int line = (block != nullptr && block->is_ready) ? block->line : 0;
+        for (uint8_t i = this->fed_count; i > 0; --i) {
+            const fed_line_t& f = this->fed_lines[(this->fed_head + this->fed_size - i) % this->fed_size];
+            if (f.line == line) {
+                e = &f;
+                break;
+            }
+        }
+        // any other line would be past the executing one and resuming from it would skip gcode, keep the last checkpoint
+        if (e == nullptr) return;
+    }
+    fed_line_t now;
+    if (e == nullptr) {
+        save_state(now, this->played_lines + 1, ftell(this->current_file_handler));
+        e = &now;
+    }
+
+    job_checkpoint_t cp;
+    memset(&cp, 0, sizeof(cp));
+    cp.active = 1;
+    strncpy(cp.filename, this->filename.c_str(), sizeof(cp.filename) - 1);
+    cp.file_size = this->file_size;
+    cp.offset = e->offset;
+    cp.line = e->line;
+    cp.elapsed_secs = this->elapsed_secs;
+    cp.feed = e->feed;
+    memcpy(cp.mpos, e->pos, sizeof(cp.mpos));
+    cp.wcs = e->wcs;
+    cp.flags = e->flags;
+    cp.motion = e->motion;
+
+    // spindle and tool are taken as they are now, neither changes within the lines the queue holds without the queue draining first
+    struct spindle_status ss;
+    if (PublicData::get_value(pwm_spindle_control_checksum, get_spindle_status_checksum, &ss) && ss.state) {
+        cp.flags |= CHECKPOINT_SPINDLE_ON;
+        cp.spindle_rpm = ss.target_rpm;
+    }
+    struct tool_status tool;
+    cp.tool = PublicData::get_value(atc_handler_checksum, get_tool_status_checksum, &tool) ? tool.active_tool : -1;
+
+    if (!this->checkpoint->write(cp) && this->job_log != nullptr) {
+        this->job_log->event(this->elapsed_secs, "checkpoint failed line %lu", cp.line);
+    }
+}
+
+void Player::checkpoint_command( string parameters, StreamOutput *stream )
+{
+    if (this->checkpoint == nullptr) {
+        stream->printf("Checkpoints are not enabled\r\n");
+        return;
+    }
+
+    string cmd = shift_parameter(parameters);
+    if (cmd == "resume") {
+        resume_checkpoint(stream);
+        return;
+    }
+    if (cmd == "clear") {
+        if (this->playing_file || this->current_file_handler != NULL) {
+            stream->printf("Currently printing, abort print first\r\n");
+        } else if (this->checkpoint->open()) {
+            end_checkpoints(false);
+            stream->printf("Checkpoint cleared\r\n");
+        }
+        return;
+    }
+
+    job_checkpoint_t cp;
+    if (!JobCheckpoint::read_latest(this->checkpoint->get_path(), cp) || !cp.active) {
+        stream->printf("No job to resume\r\n");
+        return;
+    }
+    stream->printf("file: %s\r\n", cp.filename);
+    stream->printf("line: %lu\r\n", cp.line);
+    stream->printf("offset: %lu\r\n", cp.offset);
+    stream->printf("elapsed: %lu\r\n", cp.elapsed_secs);
+    stream->printf("tool: %ld\r\n", cp.tool);
+    stream->printf("spindle: %.0f\r\n", (cp.flags & CHECKPOINT_SPINDLE_ON) ? cp.spindle_rpm : 0.0F);
+    stream->printf("position: X%.3f Y%.3f Z%.3f A%.3f\r\n", cp.mpos[0], cp.mpos[1], cp.mpos[2], cp.mpos[3]);
+}
+
+// continue a job from its last checkpoint, the machine has to be homed first
+void Player::resume_checkpoint(StreamOutput *stream)
+{
+    if (this->playing_file || THEKERNEL->is_suspending() || THEKERNEL->is_waiting()) {
+        stream->printf("Currently printing, abort print first\r\n");
+        return;
+    }
+
+    job_checkpoint_t cp;
+    if (!JobCheckpoint::read_latest(this->checkpoint->get_path(), cp) || !cp.active) {
+        stream->printf("No job to resume\r\n");
+        return;
+    }
+
+    // the moves below are in machine coordinates, they are only where the job was once the machine is homed
+    for (uint8_t i = X_AXIS; i <= Z_AXIS; i++) {
+        if (!THEROBOT->is_homed(i)) {
+            stream->printf("Home the machine first\r\n");
+            return;
+        }
+    }
+
+    // a tool change runs on its own, the moves below would not wait for it
+    struct tool_status tool;
+    if (cp.tool >= 0 && PublicData::get_value(atc_handler_checksum, get_tool_status_checksum, &tool) && tool.active_tool != cp.tool) {
+        stream->printf("Change to tool %ld first\r\n", cp.tool);
+        return;
+    }
+
+    // open_for_play refills the one fast seek link map, the old handle must not seek with it again
+    if (this->current_file_handler != NULL) {
+        fclose(this->current_file_handler);
+        this->current_file_handler = NULL;
+    }
+
+    FILE *f = open_for_play(cp.filename);
+    if (f == NULL) {
+        stream->printf("File not found: %s\r\n", cp.filename);
+        return;
+    }
+    if (fseek(f, 0, SEEK_END) != 0 || (uint32_t)ftell(f) != cp.file_size || fseek(f, cp.offset, SEEK_SET) != 0) {
+        fclose(f);
+        stream->printf("%s has changed since the checkpoint\r\n", cp.filename);
+        return;
+    }
+
+    auto send = [](const char *cmd) {
+        struct SerialMessage message;
+        message.message = cmd;
+        message.stream = &(StreamOutput::NullStream);
+        message.line = 0;
+        THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+    };
+    char buf[96];
+
+    if (cp.wcs < 6) {
+        snprintf(buf, sizeof(buf), "G%d", 54 + cp.wcs);
+    } else {
+        snprintf(buf, sizeof(buf), "G59.%d", cp.wcs - 5);
+    }
+    send(buf);
+    send("G21");
+    send("G90");
+
+    // over the start of the line at the current height, spindle on, then down at the feed it was cut with
+    if (THEROBOT->get_number_registered_motors() > A_AXIS) {
+        snprintf(buf, sizeof(buf), "G53 G0 X%.3f Y%.3f A%.3f", cp.mpos[X_AXIS], cp.mpos[Y_AXIS], cp.mpos[A_AXIS]);
+    } else {
+        snprintf(buf, sizeof(buf), "G53 G0 X%.3f Y%.3f", cp.mpos[X_AXIS], cp.mpos[Y_AXIS]);
+    }
+    send(buf);
+    if (cp.flags & CHECKPOINT_SPINDLE_ON) {
+        snprintf(buf, sizeof(buf), "M3 S%.0f", cp.spindle_rpm);
+        send(buf);
+    }
+    if (!before_resume_gcode.empty()) {
+        send(before_resume_gcode.c_str());
+    }
+    float feed = cp.feed > 0 ? cp.feed : 1000;
+    snprintf(buf, sizeof(buf), "G53 G1 Z%.3f F%.3f", cp.mpos[Z_AXIS], feed);
+    send(buf);
+
+    // modal state the line starts with
+    snprintf(buf, sizeof(buf), "G1 F%.3f", feed);
+    send(buf);
+    if (cp.motion > 0) {
+        snprintf(buf, sizeof(buf), "G%d", cp.motion - 1);
+        send(buf);
+    }
+    if (cp.flags & CHECKPOINT_INCHES) send("G20");
+    if (!(cp.flags & CHECKPOINT_ABSOLUTE)) send("G91");
+
+    this->current_file_handler = f;
+    this->filename = cp.filename;
+    this->last_filename = this->filename;
+    this->file_size = cp.file_size;
+    this->played_cnt = cp.offset;
+    this->played_lines = cp.line - 1;
+    this->elapsed_secs = cp.elapsed_secs;
+    this->playing_lines = 0;
+    this->goto_line = 0;
+    this->current_stream = nullptr;
+    this->reply_stream = THEKERNEL->streams;
+    this->playing_file = true;
+    if (this->job_log != nullptr) this->job_log->event(this->elapsed_secs, "recover %s line %lu", this->filename.c_str(), cp.line);
+    start_checkpoints();
+
+    stream->printf("Resuming %s from line %lu\r\n", cp.filename, cp.line);
 }
 
 
@@ -18,6 +18,9 @@
 using std::string;
 
 class StreamOutput;
+class GcodeMeta;
+class JobLog;
+class JobCheckpoint;
 
 class Player : public Module {
     public:
@@ -33,6 +36,17 @@ class Player : public Module {
         void on_halt(void *argument);
 
     private:
+        // resume point of each line fed to the planner, so a checkpoint can name the line being executed rather than the last one read
+        struct fed_line_t {
+            uint32_t line;
+            uint32_t offset;
+            float feed;
+            float pos[4];           // machine position the line starts from
+            uint8_t wcs;
+            uint8_t flags;
+            uint8_t motion;
+        };
+
         void play_command( string parameters, StreamOutput* stream );
         void progress_command( string parameters, StreamOutput* stream );
         void abort_command( string parameters, StreamOutput* stream );
@@ -43,7 +57,21 @@ class Player : public Module {
         void upload_command( string parameters, StreamOutput* stream );
         void download_command( string parameters, StreamOutput* stream );
         void test_command(string parameters, StreamOutput* stream );
+        void meta_command( string parameters, StreamOutput* stream );
+        void checkpoint_command( string parameters, StreamOutput* stream );
         string extract_options(string& args);
+        FILE *open_for_play(const string& fn);
+
+        void start_meta_scan(const string& fn);
+        void stop_meta_scan();
+        void scan_meta();
+
+        void start_checkpoints();
+        void end_checkpoints(bool keep);
+        void record_fed_line(size_t len);
+        void save_state(fed_line_t& f, uint32_t line, uint32_t offset);
+        void take_checkpoint();
+        void resume_checkpoint(StreamOutput *stream);
 
         void set_serial_rx_irq(bool enable);
         int inbyte(StreamOutput *stream, unsigned int timeout_ms);
@@ -72,6 +100,22 @@ class Player : public Module {
         void clear_buffered_queue();
 
         FILE* current_file_handler;
+
+        // sidecar scan of the last uploaded file, runs a chunk per main loop while not playing
+        GcodeMeta *meta_scan;
+        FILE *meta_source;
+        string meta_source_name;
+        uint32_t meta_source_size;
+        // record of played jobs, nullptr unless job_log_enable is set
+        JobLog *job_log;
+
+        JobCheckpoint *checkpoint;  // nullptr unless checkpoint_enable is set
+        fed_line_t *fed_lines;
+        uint8_t fed_head;
+        uint8_t fed_count;
+        uint8_t fed_size;
+        uint16_t checkpoint_interval;
+        uint16_t checkpoint_countdown;
         // FILE* temp_file_handler;
         long file_size;
         unsigned long played_cnt;
@@ -92,5 +136,6 @@ class Player : public Module {
             bool override_leave_heaters_on:1;
             bool inner_playing:1;
             bool laser_clustering:1;
+            bool checkpoint_due:1;
         };
 };
@@ -8,6 +8,9 @@
 #define get_progress_checksum     CHECKSUM("progress")
 #define inner_playing_checksum    CHECKSUM("inner_playing")
 #define restart_job_checksum    CHECKSUM("restart_job")
+#define scan_meta_checksum        CHECKSUM("scan_meta")
+#define stop_meta_scan_checksum   CHECKSUM("stop_meta_scan")
+#define file_in_use_checksum      CHECKSUM("file_in_use")
 
 struct pad_progress {
     unsigned int percent_complete;
@@ -15,4 +18,10 @@ struct pad_progress {
     unsigned long elapsed_secs;
     std::string filename;
 };
+
+// filled in by the caller, in_use is set if the player has the file open, playing or paused
+struct pad_file_in_use {
+    std::string filename;
+    bool in_use;
+};
 #endif
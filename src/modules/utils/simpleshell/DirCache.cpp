@@ -0,0 +1,77 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DirCache.h"
+#include "DirHandle.h"
+#include "SDFAT.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+extern SDFAT mounter;
+
+int DirCache::list(const std::string& p, uint32_t offset, uint32_t count, visitor_t visit)
+{
+    if(valid && p == path && generation == mounter.get_generation()) {
+        return list_cached(offset, count, visit);
+    }
+
+    DIR *d = opendir(p.c_str());
+    if(d == NULL) return -1;
+
+    if(buf == nullptr) buf = static_cast<char *>(malloc(DIR_CACHE_SIZE));
+    path = p;
+    generation = mounter.get_generation();
+    used = 0;
+    valid = buf != nullptr;
+
+    uint32_t n = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if(e->d_name[0] == '.') continue;
+
+        dir_record_t r;
+        size_t len = strlen(e->d_name);
+        r.flags = e->d_isdir ? DIR_RECORD_DIR : 0;
+        r.name_len = len > 255 ? 255 : len;
+        r.fdate = e->d_date;
+        r.ftime = e->d_time;
+        r.size = e->d_isdir ? 0 : e->d_fsize;
+
+        if(valid && used + sizeof(r) + r.name_len <= DIR_CACHE_SIZE) {
+            memcpy(buf + used, &r, sizeof(r));
+            memcpy(buf + used + sizeof(r), e->d_name, r.name_len);
+            used += sizeof(r) + r.name_len;
+        } else {
+            valid = false;
+        }
+
+        if(n >= offset && n - offset < count) visit(r, e->d_name);
+        n++;
+    }
+    closedir(d);
+    entries = n;
+    return n;
+}
+
+int DirCache::list_cached(uint32_t offset, uint32_t count, visitor_t visit)
+{
+    char name[256];
+    size_t pos = 0;
+    for (uint32_t n = 0; n < entries; ++n) {
+        dir_record_t r;
+        memcpy(&r, buf + pos, sizeof(r));
+        if(n >= offset) {
+            if(n - offset >= count) break;
+            memcpy(name, buf + pos + sizeof(r), r.name_len);
+            name[r.name_len] = '\0';
+            visit(r, name);
+        }
+        pos += sizeof(r) + r.name_len;
+    }
+    return entries;
+}
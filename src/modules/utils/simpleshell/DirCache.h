@@ -0,0 +1,56 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <string>
+
+#define DIR_RECORD_DIR 0x01
+#define DIR_CACHE_SIZE 4096
+
+// One directory entry, as cached and as sent by ls -b, followed by name_len chars of name without terminator
+struct dir_record_t {
+    uint8_t flags;
+    uint8_t name_len;
+    uint16_t fdate;     // FAT date and time as stored in the directory
+    uint16_t ftime;
+    uint32_t size;
+} __attribute__((packed));
+
+// Sent in front of the records by ls -b
+struct ls_header_t {
+    uint32_t total;     // entries in the directory
+    uint16_t offset;
+    uint16_t count;     // records that follow
+} __attribute__((packed));
+
+// Keeps the entries of the last listed directory, hidden entries (starting with '.') left out
+// The listing is reused until the card is remounted or a file or folder is added, removed or renamed (see SDFAT::dir_changed),
+// a directory too big for the cache is read every time
+class DirCache {
+    public:
+        typedef std::function<void(const dir_record_t&, const char *name)> visitor_t;
+
+        DirCache() : buf(nullptr), used(0), entries(0), generation(0), valid(false) {}
+
+        // calls visit for the entries offset to offset + count - 1 of path,
+        // returns the number of entries in the directory or -1 if it can not be opened
+        int list(const std::string& path, uint32_t offset, uint32_t count, visitor_t visit);
+
+    private:
+        int list_cached(uint32_t offset, uint32_t count, visitor_t visit);
+
+        std::string path;
+        char *buf;
+        size_t used;
+        uint32_t entries;
+        uint32_t generation;
+        bool valid;
+};
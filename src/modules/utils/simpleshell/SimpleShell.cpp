@@ -43,6 +43,10 @@
 #include "platform_memory.h"
 #include "SwitchPublicAccess.h"
 #include "SDFAT.h"
+#include "SDFileSystem.h"
+#include "DiskBench.h"
+#include "DirCache.h"
+#include "PlayerPublicAccess.h"
 #include "Thermistor.h"
 #include "md5.h"
 #include "utils.h"
@@ -54,6 +58,7 @@
 #include "WifiPublicAccess.h"
 
 #include "mbed.h" // for wait_ms()
+#include "us_ticker_api.h"
 
 extern unsigned int g_maximumHeapAddress;
 extern unsigned char xbuff[8200];
@@ -96,6 +101,9 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
 	{"ftype",	 SimpleShell::ftype_command},
     {"version",  SimpleShell::version_command},
     {"mem",      SimpleShell::mem_command},
+    {"prof",     SimpleShell::prof_command},
+    {"qstat",    SimpleShell::qstat_command},
+    {"sdbench",  SimpleShell::sdbench_command},
     {"get",      SimpleShell::get_command},
     {"set_temp", SimpleShell::set_temp_command},
     {"switch",   SimpleShell::switch_command},
@@ -120,6 +128,8 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
 
 int SimpleShell::reset_delay_secs = 0;
 
+static DirCache dir_cache;
+
 // Adam Greens heap walk from http://mbed.org/forum/mbed/topic/2701/?page=4#comment-22556
 static uint32_t heapWalk(StreamOutput *stream, bool verbose)
 {
@@ -179,7 +189,9 @@ static uint32_t heapWalk(StreamOutput *stream, bool verbose)
 void SimpleShell::on_module_loaded()
 {
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
-    this->register_for_event(ON_GCODE_RECEIVED);
+    for (uint16_t m : {20, 30, 331, 332, 333, 334}) {
+        this->register_for_gcode('M', m);
+    }
     this->register_for_event(ON_SECOND_TICK);
 
     reset_delay_secs = 0;
@@ -325,6 +337,12 @@ void SimpleShell::on_console_line_received( void *argument )
                 jog(possible_command, new_message.stream);
                 break;
 
+            case 'B':
+                // $B1 switches this connection to binary status frames on ?, $B0 back to text
+                new_message.stream->set_binary_status(possible_command.size() > 2 && possible_command[2] == '1');
+                new_message.stream->printf("ok\n");
+                break;
+
             default:
                 new_message.stream->printf("error:Invalid statement\n");
                 break;
@@ -356,7 +374,7 @@ void SimpleShell::on_console_line_received( void *argument )
 
         } else if (cmd == "play" || cmd == "progress" || cmd == "abort" || cmd == "suspend"
         		|| cmd == "resume" || cmd == "buffer" || cmd == "upload" || cmd == "download"
-        		|| cmd == "goto") {
+        		|| cmd == "goto" || cmd == "meta" || cmd == "checkpoint") {
             // these are handled by Player module
 
         } else if (cmd == "laser") {
@@ -393,48 +411,84 @@ void SimpleShell::ls_command( string parameters, StreamOutput *stream )
 
     path = absolute_from_relative(path);
 
-    DIR *d;
-    struct dirent *p;
-    struct tm timeinfo;
-    char dirTmp[256]; 
-    unsigned int npos=0;
-    d = opendir(path.c_str());
-    if (d != NULL) {
-        while ((p = readdir(d)) != NULL) {
-        	if (p->d_name[0] == '.') {
-        		continue;
-        	}
-        	for (int i = 0; i < NAME_MAX; i ++) {
-        		if (p->d_name[i] == ' ') p->d_name[i] = 0x01;
-        	}
-        	if (opts.find("-s", 0, 2) != string::npos) {
-        	    get_fftime(p->d_date, p->d_time, &timeinfo);
-        		// name size date
-                memset(dirTmp, 0, sizeof(dirTmp));
-                sprintf(dirTmp, "%s%s %d %04d%02d%02d%02d%02d%02d\r\n", string(p->d_name).c_str(),  p->d_isdir ? "/" : "",
-                		p->d_isdir ? 0 : p->d_fsize, timeinfo.tm_year + 1980, timeinfo.tm_mon, timeinfo.tm_mday,
-                				timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
-        	} else {
-        		// only name
-                memset(dirTmp, 0, sizeof(dirTmp));
-                sprintf(dirTmp, "%s%s\r\n", string(p->d_name).c_str(), p->d_isdir ? "/" : "");
-        	}
-        	memcpy(&xbuff[npos], dirTmp, strlen(dirTmp));
-        	npos += strlen(dirTmp);
-        	if(npos >= 7900)
-        	{
-        		stream->puts((char *)xbuff, npos);
-        		npos = 0;
-        	}
-        	
+    // -oN skips the first N entries, -nN lists at most N, -b sends a ls_header_t and dir_record_t's instead of text
+    uint32_t offset = 0, count = UINT32_MAX;
+    size_t o = opts.find("-o");
+    if(o != string::npos) offset = strtoul(opts.c_str() + o + 2, NULL, 10);
+    o = opts.find("-n");
+    if(o != string::npos) count = strtoul(opts.c_str() + o + 2, NULL, 10);
+    bool paged = offset != 0 || count != UINT32_MAX;
+    bool binary = opts.find("-b") != string::npos;
+    bool sizes = opts.find("-s") != string::npos;
+
+    unsigned int npos = 0;
+    if(binary) {
+        // the header only has room for a 16 bit count, so no more records than that are sent
+        if(count > 0xFFFF) count = 0xFFFF;
+        // the header goes first so the total is needed before listing, this also fills the cache
+        int total = dir_cache.list(path, 0, 0, [](const dir_record_t&, const char *) {});
+        if(total >= 0) {
+            ls_header_t h;
+            h.total = total;
+            h.offset = offset > 0xFFFF ? 0xFFFF : offset;
+            uint32_t left = offset < (uint32_t)total ? total - offset : 0;
+            h.count = left < count ? left : count;
+            memcpy(xbuff, &h, sizeof(h));
+            npos = sizeof(h);
+        }
+    }
+
+    int total = dir_cache.list(path, offset, count, [&](const dir_record_t& r, const char *name) {
+        char dirTmp[300];
+        size_t n;
+        if(binary) {
+            memcpy(dirTmp, &r, sizeof(r));
+            memcpy(dirTmp + sizeof(r), name, r.name_len);
+            n = sizeof(r) + r.name_len;
+        } else {
+            string fn(name);
+            for (auto& c : fn) {
+                if (c == ' ') c = 0x01;
+            }
+            bool isdir = r.flags & DIR_RECORD_DIR;
+            if (sizes) {
+                struct tm timeinfo;
+                get_fftime(r.fdate, r.ftime, &timeinfo);
+                // name size date
+                n = sprintf(dirTmp, "%s%s %lu %04d%02d%02d%02d%02d%02d\r\n", fn.c_str(), isdir ? "/" : "",
+                        r.size, timeinfo.tm_year + 1980, timeinfo.tm_mon, timeinfo.tm_mday,
+                        timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+            } else {
+                // only name
+                n = sprintf(dirTmp, "%s%s\r\n", fn.c_str(), isdir ? "/" : "");
+            }
+        }
+        if(npos + n > sizeof(xbuff)) {
+            stream->puts((char *)xbuff, npos);
+            npos = 0;
+        }
+        memcpy(&xbuff[npos], dirTmp, n);
+        npos += n;
+    });
+
+    if (total >= 0) {
+        if(!binary && paged) {
+            // hidden entries are never listed so a dot line can not be mistaken for one
+            char trailer[24];
+            size_t n = snprintf(trailer, sizeof(trailer), ".total %d\r\n", total);
+            if(npos + n > sizeof(xbuff)) {
+                stream->puts((char *)xbuff, npos);
+                npos = 0;
+            }
+            memcpy(&xbuff[npos], trailer, n);
+            npos += n;
         }
         if( npos != 0)
         {
-        	stream->puts((char *)xbuff, npos);
+            stream->puts((char *)xbuff, npos);
         }
-        closedir(d);
         if(opts.find("-e", 0, 2) != string::npos) {
-        	char eot = EOT;
+            char eot = EOT;
             stream->puts(&eot, 1);
         }
     } else {
@@ -465,7 +519,10 @@ void SimpleShell::rm_command( string parameters, StreamOutput *stream )
     }
 
     string toRemove = absolute_from_relative(path);
+    // the meta scan may hold the file and its sidecar open
+    PublicData::set_value( player_checksum, stop_meta_scan_checksum, &toRemove );
     int s = remove(toRemove.c_str());
+    mounter.dir_changed();
     if (s != 0) {
         if(send_eof) {
             stream->_putc(CAN);
@@ -499,6 +556,7 @@ void SimpleShell::rm_command( string parameters, StreamOutput *stream )
     	}*/
     	string str_lz = absolute_from_relative(lz_path);
 		s = remove(str_lz.c_str());
+		remove(change_to_meta_path(path).c_str());
 		if(send_eof) {
             stream->_putc(EOT);
     	}
@@ -518,12 +576,16 @@ void SimpleShell::mv_command( string parameters, StreamOutput *stream )
     if(!parameters.empty() && shift_parameter(parameters) == "-e") {
     	send_eof = true;
     }
+    // the meta scan may hold the file and its sidecar open, it is started again on the new name
+    bool was_scanning = PublicData::set_value( player_checksum, stop_meta_scan_checksum, &from );
     int s = rename(from.c_str(), to.c_str());
+    mounter.dir_changed();
     if (s != 0)  {
     	if (send_eof) {
     		stream->_putc(CAN);
     	}
     	stream->printf("Could not rename %s to %s\r\n", from.c_str(), to.c_str());
+    	if (was_scanning) PublicData::set_value( player_checksum, scan_meta_checksum, &from );
     } else  {
     	s = rename(md5_from.c_str(), md5_to.c_str());
 /*        if (s != 0)  {
@@ -548,6 +610,15 @@ void SimpleShell::mv_command( string parameters, StreamOutput *stream )
         	}
         }*/
         s = rename(lz_from.c_str(), lz_to.c_str());
+        if (was_scanning) {
+            // the unfinished sidecar is of no use
+            remove(change_to_meta_path(from).c_str());
+            PublicData::set_value( player_checksum, scan_meta_checksum, &to );
+        } else {
+            string meta_to = change_to_meta_path(to);
+            check_and_make_path(meta_to);
+            rename(change_to_meta_path(from).c_str(), meta_to.c_str());
+        }
         if (send_eof) {
 			stream->_putc(EOT);
 		}
@@ -566,6 +637,7 @@ void SimpleShell::mkdir_command( string parameters, StreamOutput *stream )
     	send_eof = true;
     }
     int result = mkdir(path.c_str(), 0);
+    mounter.dir_changed();
     if (result != 0) {
     	if (send_eof) {
     		stream->_putc(CAN); // ^Z terminates error
@@ -795,6 +867,88 @@ void SimpleShell::mem_command( string parameters, StreamOutput *stream)
     stream->printf("Block size: %u bytes, Tickinfo size: %u bytes\n", sizeof(Block), sizeof(Block::tickinfo_t) * Block::n_actuators);
 }
 
+// event loop profiler, prof on|off|reset, no parameter prints the cycle counts gathered so far
+void SimpleShell::prof_command( string parameters, StreamOutput *stream)
+{
+    string what = shift_parameter( parameters );
+    if (what == "on") {
+        THEKERNEL->set_profiling(true);
+    } else if (what == "off") {
+        THEKERNEL->set_profiling(false);
+    } else if (what == "reset") {
+        THEKERNEL->reset_profile();
+    } else if (!what.empty()) {
+        stream->printf("usage: prof [on|off|reset]\n");
+        return;
+    }
+    THEKERNEL->print_profile(stream);
+}
+
+// planner queue telemetry, qstat reset clears it
+void SimpleShell::qstat_command( string parameters, StreamOutput *stream)
+{
+    if (shift_parameter( parameters ) == "reset") {
+        THECONVEYOR->reset_telemetry();
+    }
+    THECONVEYOR->print_telemetry(stream);
+}
+
+extern SDFileSystem sd;
+
+static void sdbench_idle()
+{
+    THEKERNEL->call_event(ON_IDLE);
+}
+
+static void print_bench(StreamOutput *stream, const char *what, const DiskBench::result_t& r)
+{
+    stream->printf("%-14s %s %5lu ops %7lu KB/s  p50 %6lu us  p99 %6lu us  max %6lu us\n", what, r.ok ? "  " : "!!",
+        r.ops, r.kb_per_s(), r.p50_us, r.p99_us, r.max_us);
+}
+
+// sd card benchmark, sdbench [size_kb] [random_reads]
+// raw reads bypass the filesystem and its sector cache, the file tests go through both like a played job does
+void SimpleShell::sdbench_command( string parameters, StreamOutput *stream)
+{
+    string s = shift_parameter( parameters );
+    uint32_t kb = s.empty() ? 1024 : strtoul(s.c_str(), NULL, 10);
+    s = shift_parameter( parameters );
+    uint32_t count = s.empty() ? 200 : strtoul(s.c_str(), NULL, 10);
+
+    bool playing = false;
+    if (PublicData::get_value( player_checksum, is_playing_checksum, &playing ) && playing) {
+        stream->printf("Can not benchmark while playing\n");
+        return;
+    }
+    if (sd.disk_status() != 0 || sd.disk_sectors() == 0) {
+        stream->printf("No sd card\n");
+        return;
+    }
+
+    // own buffer, the idle handlers run between ops may use xbuff
+    const size_t buf_size = 4096;
+    void *v = AHB0.alloc(buf_size);
+    if(v == nullptr) v = malloc(buf_size);
+    if(v == nullptr) {
+        stream->printf("Not enough memory\n");
+        return;
+    }
+    DiskBench *bench = new DiskBench(us_ticker_read, sdbench_idle, (char *)v, buf_size);
+    const char *fn = "/sd/sdbench.tmp";
+
+    stream->printf("sd card, %lu sectors, %lu KB sequential, %lu random 512 B reads\n", sd.disk_sectors(), kb, count);
+    print_bench(stream, "raw seq read", bench->disk_sequential_read(&sd, 0, kb * 1024));
+    print_bench(stream, "raw rand read", bench->disk_random_read(&sd, sd.disk_sectors(), count));
+    print_bench(stream, "fs write", bench->file_write(fn, kb * 1024));
+    print_bench(stream, "fs seq read", bench->file_sequential_read(fn));
+    print_bench(stream, "fs rand read", bench->file_random_read(fn, count));
+    remove(fn);
+
+    delete bench;
+    if(AHB0.has(v)) AHB0.dealloc(v);
+    else free(v);
+}
+
 static uint32_t getDeviceType()
 {
 #define IAP_LOCATION 0x1FFF1FF1
@@ -1347,8 +1501,8 @@ void SimpleShell::get_command( string parameters, StreamOutput *stream)
             THEROBOT->get_s_value());
 
     } else if (what == "status") {
-        // also ? on serial and usb
-        stream->printf("%s\n", THEKERNEL->get_query_string().c_str());
+        // also ? on serial and usb, with the same Bf: field
+        THEKERNEL->send_query_string(stream);
 
     } else if (what == "compensation") {
     	float mpos[3];
@@ -1745,7 +1899,10 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("Commands:\r\n");
     stream->printf("version\r\n");
     stream->printf("mem [-v]\r\n");
-    stream->printf("ls [-s] [-e] [folder]\r\n");
+    stream->printf("prof [on|off|reset]\r\n");
+    stream->printf("qstat [reset]\r\n");
+    stream->printf("sdbench [size_kb] [random_reads]\r\n");
+    stream->printf("ls [-s] [-e] [-b] [-oN] [-nN] [folder] - -o skips N entries, -n lists at most N, -b binary\r\n");
     stream->printf("cd folder\r\n");
     stream->printf("pwd\r\n");
     stream->printf("cat file [limit] [-e] [-d 10]\r\n");
@@ -1755,6 +1912,8 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("play file [-v]\r\n");
     stream->printf("progress - shows progress of current play\r\n");
     stream->printf("abort - abort currently playing file\r\n");
+    stream->printf("meta file - shows the bounds, tools and time estimate stored after upload\r\n");
+    stream->printf("checkpoint [resume|clear] - shows where an interrupted job can be resumed, resume needs the machine homed\r\n");
     stream->printf("reset - reset smoothie\r\n");
     stream->printf("dfu - enter dfu boot loader\r\n");
     stream->printf("break - break into debugger\r\n");
@@ -55,6 +55,9 @@ private:
 
     static void switch_command(string parameters, StreamOutput *stream );
     static void mem_command(string parameters, StreamOutput *stream );
+    static void prof_command(string parameters, StreamOutput *stream );
+    static void qstat_command(string parameters, StreamOutput *stream );
+    static void sdbench_command(string parameters, StreamOutput *stream );
 
     static void net_command( string parameters, StreamOutput *stream);
     static void ap_command( string parameters, StreamOutput *stream);
@@ -0,0 +1,513 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DataLink.h"
+
+#include "libs/utils.h"
+#include "platform_memory.h"
+#include "PublicData.h"
+#include "PlayerPublicAccess.h"
+#include "checksumm.h"
+#include "us_ticker_api.h"
+#include "SDFAT.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+extern SDFAT mounter;
+
+// true if fn is the file a job is playing from, a paused job keeps it open too
+static bool is_playing(const std::string& fn)
+{
+    struct pad_file_in_use f;
+    f.filename = fn;
+    f.in_use = false;
+    return PublicData::get_value(player_checksum, file_in_use_checksum, &f) && f.in_use;
+}
+
+DataLink::DataLink(uint32_t timeout_ms)
+{
+    state = IDLE;
+    file = NULL;
+    file_buf = NULL;
+    md5[0] = '\0';
+    size = done = 0;
+    chunk_left = chunk_crc = crc = discard_left = 0;
+    tx_start = tx_end = 0;
+    cmd_len = 0;
+    timeout_us = timeout_ms * 1000;
+    last_us = 0;
+    resumable = false;
+
+    void *v = AHB0.alloc(DATA_LINK_CHUNK);
+    if(v == nullptr) v = malloc(DATA_LINK_CHUNK);
+    tx_buf = static_cast<uint8_t *>(v);
+}
+
+DataLink::~DataLink()
+{
+    reset();
+    if(AHB0.has(tx_buf)) AHB0.dealloc(tx_buf);
+    else free(tx_buf);
+}
+
+void DataLink::receive(const uint8_t *data, size_t n)
+{
+    last_us = us_ticker_read();
+    size_t i = 0;
+    while (i < n) {
+        if(state == RECEIVING) {
+            size_t k = n - i;
+            if(k > size - done) k = size - done;
+            if(fwrite(data + i, 1, k, file) != k) {
+                // the rest of the upload still has to be taken off the link before the next command
+                fail("write failed");
+                discard_left = size - done - k;
+                if(discard_left > 0) state = DISCARDING;
+            } else {
+                done += k;
+                if(done == size) finish_put();
+            }
+            i += k;
+            continue;
+        }
+
+        if(state == CHUNK) {
+            size_t k = n - i;
+            if(k > chunk_left) k = chunk_left;
+            if(fwrite(data + i, 1, k, file) != k) {
+                // what was confirmed stays, the upload can be resumed once the card is sorted out
+                fail("write failed");
+                discard_left = chunk_left - k;
+                if(discard_left > 0) state = DISCARDING;
+            } else {
+                crc = crc32(crc, data + i, k);
+                chunk_left -= k;
+                if(chunk_left == 0) end_chunk();
+            }
+            i += k;
+            continue;
+        }
+
+        if(state == DISCARDING) {
+            size_t k = n - i;
+            if(k > discard_left) k = discard_left;
+            discard_left -= k;
+            i += k;
+            if(discard_left == 0) state = (file != NULL) ? RESUMING : IDLE;
+            continue;
+        }
+
+        char c = data[i++];
+        if(c == '\r') continue;
+        if(c == '\n') {
+            cmd[cmd_len] = '\0';
+            if(cmd_len > 0) command(cmd);
+            cmd_len = 0;
+        } else if(cmd_len < DATA_LINK_CMD_SIZE - 1) {
+            cmd[cmd_len++] = c;
+        }
+    }
+}
+
+void DataLink::poll()
+{
+    if(state == IDLE) return;
+
+    if(us_ticker_read() - last_us > timeout_us) {
+        if(state == DISCARDING && file == NULL) state = IDLE;
+        else fail("timeout");
+        return;
+    }
+
+    if(state != SENDING || tx_pending() > 0) return;
+
+    size_t n = size - done;
+    if(n > DATA_LINK_CHUNK) n = DATA_LINK_CHUNK;
+    if(fread(tx_buf, 1, n, file) != n) {
+        // the client is already taking file data and would take an error reply as part of it, it sees a short file
+        close_file();
+        state = IDLE;
+        return;
+    }
+    tx_start = 0;
+    tx_end = n;
+    done += n;
+    if(done == size) {
+        close_file();
+        state = IDLE;
+    }
+}
+
+void DataLink::reset()
+{
+    // a resumable upload keeps what was confirmed
+    bool drop_part = state == RECEIVING;
+    close_file();
+    if(drop_part) remove_part(path);
+    state = IDLE;
+    tx_start = tx_end = 0;
+    cmd_len = 0;
+}
+
+void DataLink::tx_sent(size_t n)
+{
+    if(n > 0) last_us = us_ticker_read();
+    tx_start += n;
+    if(tx_start >= tx_end) tx_start = tx_end = 0;
+}
+
+void DataLink::command(char *line)
+{
+    std::string params(line);
+    std::string cmd = shift_parameter(params);
+
+    if(cmd == "abort") {
+        if(state == SENDING) {
+            close_file();
+            state = IDLE;
+            tx_start = tx_end = 0;
+        } else if(state == RESUMING) {
+            close_file();
+            state = IDLE;
+        }
+        reply("aborted\n");
+    } else if(state == RESUMING) {
+        if(cmd == "chunk") start_chunk(params);
+        else reply("error busy\n");
+    } else if(state != IDLE) {
+        // only a download takes commands, and a reply would be taken as part of the file
+    } else if(tx_buf == nullptr) {
+        // nothing can be sent back, not even an error
+    } else if(cmd == "put") {
+        start_put(params, false);
+    } else if(cmd == "rput") {
+        start_put(params, true);
+    } else if(cmd == "get") {
+        start_get(params);
+    } else if(cmd == "stat") {
+        stat(params);
+    } else if(cmd == "drop") {
+        drop(params);
+    } else {
+        reply("error unknown command %.20s\n", cmd.c_str());
+    }
+}
+
+void DataLink::start_put(std::string params, bool resume)
+{
+    path = absolute_from_relative(shift_parameter(params));
+    std::string sz = shift_parameter(params);
+    std::string sum = shift_parameter(params);
+    if(sz.empty() || (!sum.empty() && sum.size() != 32) || (resume && sum.empty())) {
+        reply(resume ? "error usage: rput <file> <size> <md5>\n" : "error usage: put <file> <size> [md5]\n");
+        return;
+    }
+    // compressed uploads are unpacked in one go, that has to stay with the upload command
+    if(path.find(".lz") != std::string::npos) {
+        reply("error compressed files can not be sent here\n");
+        return;
+    }
+    if(is_playing(path)) {
+        reply("error file is playing\n");
+        return;
+    }
+
+    char *end;
+    unsigned long n = strtoul(sz.c_str(), &end, 10);
+    if(*end != '\0' || !isdigit((unsigned char)sz[0])) {
+        reply("error bad size %.20s\n", sz.c_str());
+        return;
+    }
+
+    strcpy(md5, sum.c_str());
+    size = n;
+    done = 0;
+    resumable = resume;
+    std::string part = path + ".part";
+
+    if(!resumable) {
+        if(!open_file(part.c_str(), "wb")) {
+            reply("error can not open %.60s\n", path.c_str());
+            return;
+        }
+        state = RECEIVING;
+        last_us = us_ticker_read();
+        reply("ok\n");
+        if(size == 0) finish_put();
+        return;
+    }
+
+    // carry on from the last confirmed chunk if the record is of this same file
+    part_record_t r;
+    if(read_record(path, r) && r.size == size && memcmp(r.md5, md5, 32) == 0 && open_file(part.c_str(), "r+")) {
+        fseek(file, 0, SEEK_END);
+        if((uint32_t)ftell(file) >= r.confirmed) done = r.confirmed;
+        fseek(file, done, SEEK_SET);
+    }
+    if(file == NULL && !open_file(part.c_str(), "w+")) {
+        reply("error can not open %.60s\n", path.c_str());
+        return;
+    }
+    record.magic = PART_RECORD_MAGIC;
+    record.size = size;
+    record.confirmed = done;
+    memcpy(record.md5, md5, sizeof(record.md5));
+    if(!write_record()) {
+        close_file();
+        reply("error can not write %.60s.rec\n", part.c_str());
+        return;
+    }
+
+    state = RESUMING;
+    last_us = us_ticker_read();
+    reply("ok %lu\n", done);
+    if(done == size) finish_put();
+}
+
+void DataLink::start_chunk(std::string params)
+{
+    uint32_t len = strtoul(shift_parameter(params).c_str(), NULL, 10);
+    chunk_crc = strtoul(shift_parameter(params).c_str(), NULL, 16);
+    if(len == 0) {
+        reply("error usage: chunk <len> <crc32>\n");
+        return;
+    }
+    if(len > size - done) {
+        // the data is on its way anyway, it is skipped and the client told where to go on from
+        discard_left = len;
+        state = DISCARDING;
+        reply("nak %lu\n", done);
+        return;
+    }
+    chunk_left = len;
+    crc = 0;
+    state = CHUNK;
+}
+
+void DataLink::end_chunk()
+{
+    state = RESUMING;
+    if(crc != chunk_crc) {
+        // the chunk is written over when it is sent again
+        fseek(file, done, SEEK_SET);
+        reply("nak %lu\n", done);
+        return;
+    }
+    done = ftell(file);
+    if(!sync_file()) {
+        fail("write failed");
+        return;
+    }
+    record.confirmed = done;
+    if(!write_record()) {
+        fail("write failed");
+        return;
+    }
+    reply("ack %lu\n", done);
+    if(done == size) finish_put();
+}
+
+void DataLink::finish_put()
+{
+    std::string part = path + ".part";
+    bool ok = fflush(file) == 0;
+    close_file();
+    state = IDLE;
+
+    if(!ok) {
+        remove_part(path);
+        reply("error write failed\n");
+        return;
+    }
+    // a job may have been started from the old file while this one came in, a resumable upload can be finished later
+    if(is_playing(path)) {
+        if(!resumable) remove_part(path);
+        reply("error file is playing\n");
+        return;
+    }
+    // the meta scan of the old file may hold it and its sidecar open, the new file is scanned below
+    PublicData::set_value(player_checksum, stop_meta_scan_checksum, &path);
+    remove(path.c_str());
+    if(rename(part.c_str(), path.c_str()) != 0) {
+        remove_part(path);
+        reply("error can not rename to %.60s\n", path.c_str());
+        return;
+    }
+    remove((part + ".rec").c_str());
+    remove((part + ".rec.tmp").c_str());
+    mounter.dir_changed();
+
+    if(path.find("firmware.bin") == std::string::npos) {
+        std::string md5_path = change_to_md5_path(path);
+        if(md5[0] != '\0') {
+            check_and_make_path(md5_path);
+            FILE *f = fopen(md5_path.c_str(), "wb");
+            if(f != NULL) {
+                fwrite(md5, 1, 32, f);
+                fclose(f);
+            }
+        } else {
+            // an md5 left from an older version of the file would be wrong now
+            remove(md5_path.c_str());
+        }
+        PublicData::set_value(player_checksum, scan_meta_checksum, &path);
+    }
+    reply("done %lu\n", size);
+}
+
+void DataLink::start_get(std::string params)
+{
+    path = absolute_from_relative(shift_parameter(params));
+    std::string offset = shift_parameter(params);
+    if(!open_file(path.c_str(), "rb")) {
+        reply("error can not open %.60s\n", path.c_str());
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    done = strtoul(offset.c_str(), NULL, 10);
+    if(done > size) {
+        close_file();
+        reply("error offset past the end\n");
+        return;
+    }
+    fseek(file, done, SEEK_SET);
+    last_us = us_ticker_read();
+    reply("ok %lu\n", size);
+    if(done == size) {
+        close_file();
+    } else {
+        state = SENDING;
+    }
+}
+
+void DataLink::stat(std::string params)
+{
+    std::string fn = absolute_from_relative(shift_parameter(params));
+    part_record_t r;
+    if(read_record(fn, r)) {
+        reply("part %lu %lu %.32s\n", r.confirmed, r.size, r.md5);
+    } else {
+        reply("part 0 0\n");
+    }
+}
+
+void DataLink::drop(std::string params)
+{
+    remove_part(absolute_from_relative(shift_parameter(params)));
+    reply("ok\n");
+}
+
+bool DataLink::open_file(const char *fn, const char *mode)
+{
+    file = fopen(fn, mode);
+    if(file == NULL) return false;
+    // only held while a transfer is open
+    file_buf = static_cast<char *>(malloc(DATA_LINK_FILE_BUF));
+    if(file_buf != NULL) setvbuf(file, file_buf, _IOFBF, DATA_LINK_FILE_BUF);
+    return true;
+}
+
+void DataLink::close_file()
+{
+    if(file != NULL) {
+        fclose(file);
+        file = NULL;
+    }
+    free(file_buf);
+    file_buf = NULL;
+}
+
+// FatFs keeps the last partial sector and the file size in ram until f_sync, which stdio here only gets to on close,
+// so the part file is closed and opened again to have everything up to done on the card
+bool DataLink::sync_file()
+{
+    int r = fclose(file);
+    file = fopen((path + ".part").c_str(), "r+");
+    if(file == NULL) return false;
+    if(file_buf != NULL) setvbuf(file, file_buf, _IOFBF, DATA_LINK_FILE_BUF);
+    return r == 0 && fseek(file, done, SEEK_SET) == 0;
+}
+
+bool DataLink::read_record_file(const std::string& rec, part_record_t& r)
+{
+    FILE *f = fopen(rec.c_str(), "r");
+    if(f == NULL) return false;
+    bool ok = fread(&r, sizeof(r), 1, f) == 1;
+    fclose(f);
+    return ok && r.magic == PART_RECORD_MAGIC && r.confirmed <= r.size &&
+           r.check == crc32(0, reinterpret_cast<const uint8_t *>(&r), offsetof(part_record_t, check));
+}
+
+// power lost between the remove and the rename in write_record leaves only the new record, as .tmp
+bool DataLink::read_record(const std::string& fn, part_record_t& r)
+{
+    return read_record_file(fn + ".part.rec", r) || read_record_file(fn + ".part.rec.tmp", r);
+}
+
+// written whole to a temporary file and closed, closing is what puts it on the card, then it replaces the old record
+// FatFs rename does not overwrite, so there is a moment with no .part.rec, read_record falls back to the .tmp then
+bool DataLink::write_record()
+{
+    std::string rec = path + ".part.rec";
+    std::string tmp = rec + ".tmp";
+    record.check = crc32(0, reinterpret_cast<const uint8_t *>(&record), offsetof(part_record_t, check));
+    FILE *f = fopen(tmp.c_str(), "w");
+    if(f == NULL) return false;
+    bool ok = fwrite(&record, sizeof(record), 1, f) == 1;
+    if(fclose(f) != 0 || !ok) return false;
+    remove(rec.c_str());
+    return rename(tmp.c_str(), rec.c_str()) == 0;
+}
+
+void DataLink::remove_part(const std::string& fn)
+{
+    remove((fn + ".part").c_str());
+    remove((fn + ".part.rec").c_str());
+    remove((fn + ".part.rec.tmp").c_str());
+    mounter.dir_changed();
+}
+
+// drops what was in progress and tells the client why
+void DataLink::fail(const char *reason)
+{
+    bool drop_part = state == RECEIVING;
+    close_file();
+    if(drop_part) remove_part(path);
+    state = IDLE;
+    reply("error %s\n", reason);
+}
+
+void DataLink::reply(const char *format, ...)
+{
+    if(tx_buf == nullptr) return;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf((char *)tx_buf + tx_end, DATA_LINK_CHUNK - tx_end, format, args);
+    va_end(args);
+    // a reply that does not fit is dropped whole
+    if(n > 0 && tx_end + n < DATA_LINK_CHUNK) tx_end += n;
+}
+
+// the crc32 of zip and zlib, crc is 0 to start or the crc of the data before
+uint32_t DataLink::crc32(uint32_t crc, const uint8_t *data, size_t n)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+    }
+    return ~crc;
+}
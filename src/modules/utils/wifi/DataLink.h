@@ -0,0 +1,110 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#define DATA_LINK_CHUNK      1460   // one packet, download data is read and sent this much at a time
+#define DATA_LINK_FILE_BUF   4096   // stdio buffer while a transfer is open, the card is written a cluster at a time
+#define DATA_LINK_CMD_SIZE   160
+#define PART_RECORD_MAGIC    0x54524150 // "PART"
+
+// Progress of a resumable upload, kept in <file>.part.rec next to the data in <file>.part
+// confirmed bytes of the part file have passed their chunk check and been synced to the card
+struct part_record_t {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t confirmed;
+    char md5[32];             // of the whole file, a resume has to be of the same file
+    uint32_t check;           // crc32 of the fields above
+} __attribute__((packed));
+
+// File transfers on their own tcp link, run a packet at a time from on_idle so they can go on while a job plays
+// A command is a line, replies are lines too:
+//   put <file> <size> [md5]   -> "ok", then exactly size bytes are taken as the file, "done <size>" once it is stored
+//   rput <file> <size> <md5>  -> "ok <offset>", a resumable upload continuing from offset, sent as
+//     chunk <len> <crc32>     followed by len bytes -> "ack <offset>", or "nak <offset>" if the crc does not match
+//                                and the chunk has to be sent again, "done <size>" follows the last ack
+//   stat <file>               -> "part <offset> <size> <md5>" of an unfinished resumable upload, "part 0 0" if there is none
+//   drop <file>               -> "ok", the unfinished upload is deleted
+//   get <file> [offset]       -> "ok <size>", then the file from offset on
+//   abort                     -> stops a download or a resumable upload, which can be resumed later,
+//                                a plain upload is ended by closing the connection
+// failures reply "error <reason>" and the link goes back to taking commands
+// An upload goes to <file>.part and only replaces <file> when complete, the file being played can not be replaced
+class DataLink {
+    public:
+        DataLink(uint32_t timeout_ms);
+        ~DataLink();
+
+        // data received on the link
+        void receive(const uint8_t *data, size_t n);
+        // reads the next chunk of a download once the last one is sent, and ends transfers the client abandoned
+        void poll();
+        // the client went away, anything in progress is dropped
+        void reset();
+
+        // replies and download data waiting to go out
+        size_t tx_pending() const { return tx_end - tx_start; }
+        const uint8_t *tx_data() const { return tx_buf + tx_start; }
+        void tx_sent(size_t n);
+
+        bool is_busy() const { return state != IDLE; }
+
+        static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t n);
+
+    private:
+        // DISCARDING takes the rest of a failed upload or a rejected chunk off the link, RESUMING waits for the next chunk
+        enum STATE { IDLE, RECEIVING, DISCARDING, RESUMING, CHUNK, SENDING };
+
+        void command(char *line);
+        void start_put(std::string params, bool resumable);
+        void start_chunk(std::string params);
+        void end_chunk();
+        void finish_put();
+        void start_get(std::string params);
+        void stat(std::string params);
+        void drop(std::string params);
+        bool open_file(const char *fn, const char *mode);
+        void close_file();
+        bool read_record(const std::string& fn, part_record_t& r);
+        static bool read_record_file(const std::string& rec, part_record_t& r);
+        bool sync_file();
+        bool write_record();
+        static void remove_part(const std::string& fn);
+        void fail(const char *reason);
+        void reply(const char *format, ...) __attribute__ ((format(printf, 2, 3)));
+
+        STATE state;
+        FILE *file;
+        char *file_buf;
+        part_record_t record;     // of a resumable upload, rewritten after each chunk
+        std::string path;
+        char md5[33];
+        uint32_t size;
+        uint32_t done;
+        uint32_t chunk_left;
+        uint32_t chunk_crc;       // expected
+        uint32_t crc;             // of the chunk so far
+        uint32_t discard_left;
+
+        uint8_t *tx_buf;
+        size_t tx_start;
+        size_t tx_end;
+
+        char cmd[DATA_LINK_CMD_SIZE];
+        size_t cmd_len;
+
+        uint32_t timeout_us;
+        uint32_t last_us;
+
+        bool resumable;
+};
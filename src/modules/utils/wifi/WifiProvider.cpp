@@ -28,35 +28,57 @@
 #include "libs/StreamOutput.h"
 #include "SwitchPublicAccess.h"
 #include "WifiPublicAccess.h"
+#include "DataLink.h"
 #include "libs/utils.h"
+#include "platform_memory.h"
 
 #include "libs/SerialMessage.h"
 #include "libs/StreamOutput.h"
 
 #include "port_api.h"
+#include "us_ticker_api.h"
 #include "InterruptIn.h"
 
 #include "gpio.h"
 
 #include <math.h>
+#include <string.h>
+#include <stdlib.h>
 
 #define wifi_checksum                     CHECKSUM("wifi")
 #define wifi_enable                       CHECKSUM("enable")
 #define wifi_interrupt_pin_checksum       CHECKSUM("interrupt_pin")
 #define machine_name_checksum             CHECKSUM("machine_name")
 #define tcp_port_checksum		          CHECKSUM("tcp_port")
+#define data_port_checksum		          CHECKSUM("data_port")
 #define udp_send_port_checksum		      CHECKSUM("udp_send_port")
 #define udp_recv_port_checksum		      CHECKSUM("udp_recv_port")
 #define tcp_timeout_s_checksum			  CHECKSUM("tcp_timeout_s")
+#define telemetry_max_hz_checksum		  CHECKSUM("telemetry_max_hz")
+#define rx_buffer_size_checksum			  CHECKSUM("rx_buffer_size")
+#define tx_buffer_size_checksum			  CHECKSUM("tx_buffer_size")
+#define tx_flush_ms_checksum			  CHECKSUM("tx_flush_ms")
 
 
 WifiProvider::WifiProvider()
 {
 	tcp_link_no = 0;
 	udp_link_no = 1;
+	data_link_no = 2;
+	data_port = 0;
+	data_link = nullptr;
 	wifi_init_ok = false;
 	has_data_flag = false;
 	connection_fail_count = 0;
+	telemetry_port = 0;
+	telemetry_lease_s = 0;
+	telemetry_last_us = 0;
+	tx_buf = nullptr;
+	tx_size = 0;
+	tx_start = tx_end = 0;
+	tx_staged_us = 0;
+	tx_line_pending = false;
+	memset(&tx_stats, 0, sizeof(tx_stats));
 }
 
 void WifiProvider::on_module_loaded()
@@ -71,7 +93,14 @@ void WifiProvider::on_module_loaded()
 	this->udp_send_port = THEKERNEL->config->value(wifi_checksum, udp_send_port_checksum)->by_default(3333)->as_int();
 	this->udp_recv_port = THEKERNEL->config->value(wifi_checksum, udp_recv_port_checksum)->by_default(4444)->as_int();
 	this->tcp_timeout_s = THEKERNEL->config->value(wifi_checksum, tcp_timeout_s_checksum)->by_default(10)->as_int();
+	this->data_port = THEKERNEL->config->value(wifi_checksum, data_port_checksum)->by_default(0)->as_int();
+	if (this->data_port > 0) {
+		this->data_link = new DataLink(this->tcp_timeout_s * 1000);
+	}
 	this->machine_name = THEKERNEL->config->value(wifi_checksum, machine_name_checksum)->by_default("CARVERA")->as_string();
+	this->telemetry_max_hz = THEKERNEL->config->value(wifi_checksum, telemetry_max_hz_checksum)->by_default(50)->as_int();
+	if (this->telemetry_max_hz < 1) this->telemetry_max_hz = 1;
+	this->buffer.init(THEKERNEL->config->value(wifi_checksum, rx_buffer_size_checksum)->by_default(256)->as_int());
 
     // Init Wifi Module
     this->init_wifi_module(false);
@@ -92,6 +121,15 @@ void WifiProvider::on_module_loaded()
     }
     delete smoothie_pin;
 
+    size_t tx_n = THEKERNEL->config->value(wifi_checksum, tx_buffer_size_checksum)->by_default(2048)->as_int();
+    void *v = AHB0.alloc(tx_n);
+    if (v == nullptr) v = malloc(tx_n);
+    if (v != nullptr) {
+        this->tx_buf = static_cast<char *>(v);
+        this->tx_size = tx_n;
+    }
+    this->tx_flush_us = THEKERNEL->config->value(wifi_checksum, tx_flush_ms_checksum)->by_default(5)->as_int() * 1000;
+
     // Add to the pack of streams kernel can call to, for example for broadcasting
     THEKERNEL->streams->append_stream(this);
 
@@ -100,11 +138,13 @@ void WifiProvider::on_module_loaded()
     halt_flag = false;
 
 	this->register_for_event(ON_IDLE);
-    this->register_for_event(ON_GCODE_RECEIVED);
+    for (uint16_t m : {481, 482, 483, 489}) {
+        this->register_for_gcode('M', m);
+    }
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_SECOND_TICK);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(ON_GET_PUBLIC_DATA, wlan_checksum);
+    this->register_for_public_data(ON_SET_PUBLIC_DATA, wlan_checksum);
 }
 
 
@@ -115,13 +155,21 @@ void WifiProvider::on_pin_rise()
 
 void WifiProvider::receive_wifi_data() {
 	u8 link_no;
+	u8 remote_ip[4];
+	u16 remote_port;
 	u16 received = 0;
 	u16 status;
 
 	while (true)
 	{
-		received = M8266WIFI_SPI_RecvData(WifiData, WIFI_DATA_MAX_SIZE, WIFI_DATA_TIMEOUT_MS, &link_no, &status);
+		received = M8266WIFI_SPI_RecvData_ex(WifiData, WIFI_DATA_MAX_SIZE, WIFI_DATA_TIMEOUT_MS, &link_no, remote_ip, &remote_port, &status);
 		if (link_no == udp_link_no) {
+			handle_udp_command(received, remote_ip, remote_port);
+			return;
+		}
+		if (link_no == data_link_no) {
+			// one packet per pass, the module holds the rest and the client waits on the tcp window
+			if (data_link != nullptr) data_link->receive(WifiData, received);
 			return;
 		}
 		for (int i = 0; i < received; i ++) {
@@ -153,7 +201,7 @@ void WifiProvider::receive_wifi_data() {
 //	        	received = '\n';
 				WifiData[i] = '\n';
 	        }
-	        this->buffer.push_back(char(WifiData[i]));
+	        this->buffer.put(char(WifiData[i]));
 		}
 		if (received < WIFI_DATA_MAX_SIZE) {
 			return;
@@ -161,6 +209,36 @@ void WifiProvider::receive_wifi_data() {
 	}
 }
 
+// "telemetry <hz>" sent to the udp receive port streams binary status frames back to the sender, 0 stops
+// the client has to send it again within TELEMETRY_LEASE_S to keep the stream going
+void WifiProvider::handle_udp_command(u16 len, u8 remote_ip[4], u16 remote_port)
+{
+	if (len < 9 || len >= WIFI_DATA_MAX_SIZE || strncmp((char *)WifiData, "telemetry", 9) != 0) return;
+	WifiData[len] = '\0';
+	int hz = atoi((char *)WifiData + 9);
+	if (hz <= 0) {
+		telemetry_lease_s = 0;
+		return;
+	}
+	if (hz > telemetry_max_hz) hz = telemetry_max_hz;
+	snprintf(telemetry_address, sizeof(telemetry_address), "%d.%d.%d.%d", remote_ip[0], remote_ip[1], remote_ip[2], remote_ip[3]);
+	telemetry_port = remote_port;
+	telemetry_period_us = 1000000 / hz;
+	telemetry_lease_s = TELEMETRY_LEASE_S;
+}
+
+void WifiProvider::send_telemetry()
+{
+	uint32_t now = us_ticker_read();
+	if (now - telemetry_last_us < telemetry_period_us) return;
+	telemetry_last_us = now;
+
+	const uint8_t *frame;
+	size_t n = THEKERNEL->get_status_frame(&frame, true);
+	u16 status = 0;
+	M8266WIFI_SPI_Send_Udp_Data((u8 *)frame, n, udp_link_no, telemetry_address, telemetry_port, &status);
+}
+
 bool WifiProvider::ready() {
 	return M8266WIFI_SPI_Has_DataReceived();
 }
@@ -198,6 +276,8 @@ void WifiProvider::on_second_tick(void *)
 	u8 client_num = 0;
 	ClientInfo RemoteClients[15];
 
+	if (telemetry_lease_s > 0) telemetry_lease_s--;
+
 	if (!wifi_init_ok || THEKERNEL->is_uploading()) return;
 
 	M8266WIFI_SPI_List_Clients_On_A_TCP_Server(tcp_link_no, &client_num, RemoteClients, &status);
@@ -263,12 +343,30 @@ void WifiProvider::on_idle(void *argument)
 
     if (query_flag) {
         query_flag = false;
-        puts(THEKERNEL->get_query_string().c_str());
+        if (is_binary_status()) {
+            const uint8_t *frame;
+            size_t n = THEKERNEL->get_status_frame(&frame);
+            puts(reinterpret_cast<const char *>(frame), n);
+        } else {
+            THEKERNEL->send_query_string(this);
+        }
     }
 
     if (diagnose_flag) {
     	diagnose_flag = false;
-    	puts(THEKERNEL->get_diagnose_string().c_str(), 0);
+    	puts(THEKERNEL->get_diagnose_string(), 0);
+    }
+
+    if (telemetry_lease_s > 0 && wifi_init_ok) {
+        send_telemetry();
+    }
+
+    if (tx_start < tx_end && (tx_line_pending || tx_end - tx_start >= WIFI_DATA_MAX_SIZE || us_ticker_read() - tx_staged_us >= tx_flush_us)) {
+        send_tx(WIFI_TX_IDLE_LOOPS);
+    }
+
+    if (data_link != nullptr && wifi_init_ok) {
+        service_data_link();
     }
 
     if (halt_flag) {
@@ -283,37 +381,101 @@ void WifiProvider::on_idle(void *argument)
     }
 }
 
+// at most one packet of a transfer goes out per pass so a download never holds up the main loop
+void WifiProvider::service_data_link()
+{
+	data_link->poll();
+	size_t n = data_link->tx_pending();
+	if (n == 0) return;
+	if (n > WIFI_DATA_MAX_SIZE) n = WIFI_DATA_MAX_SIZE;
+
+	u16 status = 0;
+	u32 sent = M8266WIFI_SPI_Send_BlockData((u8 *)data_link->tx_data(), n, WIFI_TX_IDLE_LOOPS, data_link_no, NULL, 0, &status);
+	data_link->tx_sent(sent);
+	if (sent < n) {
+		u8 err = status & 0xff;
+		if (err == 0x13 || err == 0x14 || err == 0x15 || err == 0x18) {
+			data_link->reset();
+		}
+	}
+}
+
 void WifiProvider::on_main_loop(void *argument)
 {
-    if( this->has_char('\n') ){
-        string received;
-        received.reserve(20);
-        while(1){
-           char c;
-           this->buffer.pop_front(c);
-           if( c == '\n' ){
-                struct SerialMessage message;
-                message.message = received;
-                message.stream = this;
-                THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
-                return;
-            }else{
-                received += c;
-            }
-        }
+    if( this->buffer.has_line() ){
+        struct SerialMessage message;
+        this->buffer.get_line(message.message);
+        message.stream = this;
+        THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
     }
 }
 
+// output is staged and sent from on_idle so many small writes share one SPI transaction,
+// a client that does not take data makes us drop output instead of stalling the main loop
 int WifiProvider::puts(const char* s, int size)
 {
-	size_t total_length = size == 0 ? strlen(s) : size;
-    size_t sent_index = 0;
+	size_t n = size == 0 ? strlen(s) : size;
+	if (tx_size == 0) return send_direct(s, n);
+
+	size_t done = 0;
+	while (done < n) {
+		done += stage_tx(s + done, n - done);
+		if (done < n && send_tx(WIFI_TX_FULL_LOOPS) == 0) {
+			tx_stats.dropped += n - done;
+			break;
+		}
+	}
+	// file transfers wait for the reply with on_idle stopped, so nothing may be left staged
+	if (THEKERNEL->is_uploading()) flush();
+	return done;
+}
+
+int WifiProvider::_putc(int c)
+{
+	char ch = c;
+	return puts(&ch, 1);
+}
+
+void WifiProvider::flush()
+{
+	send_tx(WIFI_TX_FLUSH_LOOPS);
+}
+
+// appends as much of s as fits, returns the number of chars taken
+size_t WifiProvider::stage_tx(const char *s, size_t n)
+{
+	if (tx_start == tx_end) {
+		tx_start = tx_end = 0;
+		tx_staged_us = us_ticker_read();
+	} else if (tx_end + n > tx_size && tx_start > 0) {
+		memmove(tx_buf, tx_buf + tx_start, tx_end - tx_start);
+		tx_end -= tx_start;
+		tx_start = 0;
+	}
+	if (n > tx_size - tx_end) n = tx_size - tx_end;
+	if (n == 0) return 0;
+
+	memcpy(tx_buf + tx_end, s, n);
+	tx_end += n;
+	if (memchr(s, '\n', n) != nullptr) tx_line_pending = true;
+	if (tx_end - tx_start > tx_stats.max_fill) tx_stats.max_fill = tx_end - tx_start;
+	return n;
+}
+
+// sends the staged data a packet at a time until the module stops taking it, returns the number of bytes sent
+size_t WifiProvider::send_tx(u32 max_loops)
+{
+	size_t total = 0;
 	u16 status = 0;
-	u32 sent = 0;
-	u32 to_send = 0;
-    while (sent_index < total_length) {
-    	to_send = total_length - sent_index > WIFI_DATA_MAX_SIZE ? WIFI_DATA_MAX_SIZE : total_length - sent_index;
-    	memcpy(WifiData, s + sent_index, to_send);
+	while (tx_start < tx_end) {
+		u32 n = tx_end - tx_start > WIFI_DATA_MAX_SIZE ? WIFI_DATA_MAX_SIZE : tx_end - tx_start;
+		u32 sent = M8266WIFI_SPI_Send_BlockData((u8 *)tx_buf + tx_start, n, max_loops, tcp_link_no, NULL, 0, &status);
+		tx_start += sent;
+		total += sent;
+		tx_stats.bytes += sent;
+		if (sent > 0) tx_stats.packets++;
+		if (sent == n) continue;
+
 		// errcode:
 		// 	0x13: Wrong link_no used
 		// 	0x14: connection by link_no not present
@@ -321,26 +483,42 @@ int WifiProvider::puts(const char* s, int size)
 		// 	0x18: No clients connecting to this TCP server
 		// 	0x1E: too many errors ecountered during sending can not fixed
 		// 	0x1F: Other errors
-    	sent = M8266WIFI_SPI_Send_BlockData(WifiData, to_send, 5000, tcp_link_no, NULL, 0, &status);
-    	sent_index += sent;
-		if (sent == to_send) {
-			continue;
+		u8 err = status & 0xff;
+		if (err == 0x13 || err == 0x14 || err == 0x15 || err == 0x18) {
+			// nobody to send to, the output is stale by the time a client connects
+			tx_stats.dropped += tx_end - tx_start;
+			tx_start = tx_end;
 		} else {
-    		break;
+			tx_stats.stalls++;
 		}
-    }
-    return sent_index;
+		break;
+	}
+	if (tx_start == tx_end) {
+		tx_start = tx_end = 0;
+		tx_line_pending = false;
+	}
+	return total;
 }
 
-int WifiProvider::_putc(int c)
+// used only when the staging buffer could not be allocated
+size_t WifiProvider::send_direct(const char *s, size_t n)
 {
+	size_t sent_index = 0;
 	u16 status = 0;
-	u8 to_send = c;
-	if (M8266WIFI_SPI_Send_Data(&to_send, 1, tcp_link_no, &status) == 0) {
-		return 0;
-	} else {
-		return 1;
+	while (sent_index < n) {
+		u32 to_send = n - sent_index > WIFI_DATA_MAX_SIZE ? WIFI_DATA_MAX_SIZE : n - sent_index;
+		memcpy(WifiData, s + sent_index, to_send);
+		u32 sent = M8266WIFI_SPI_Send_BlockData(WifiData, to_send, WIFI_TX_FLUSH_LOOPS, tcp_link_no, NULL, 0, &status);
+		sent_index += sent;
+		if (sent != to_send) break;
 	}
+	return sent_index;
+}
+
+void WifiProvider::print_tx_stats(StreamOutput *stream)
+{
+	stream->printf("tx: %lu bytes in %lu packets, %lu stalls, %lu dropped, max fill %lu/%u, pending %u\n",
+		tx_stats.bytes, tx_stats.packets, tx_stats.stalls, tx_stats.dropped, tx_stats.max_fill, tx_size, tx_end - tx_start);
 }
 
 int WifiProvider::_getc()
@@ -361,6 +539,11 @@ int WifiProvider::gets(char** buf, int size)
 		// THEKERNEL->streams->printf("gets, data from udp");
 		return 0;
 	}
+	if (link_no == data_link_no) {
+		// not part of the upload, the transfer carries on once on_idle runs again
+		if (data_link != nullptr) data_link->receive(WifiData, received);
+		return 0;
+	}
 	if (int(status & 0xff) == 32 || int(status & 0xff) == 34 || int(status & 0xff) == 47) {
 		THEKERNEL->streams->printf("gets, received: %d, status:%d, high: %d, low: %d!\n", received, status, int(status >> 8), int(status & 0xff));
 	}
@@ -368,17 +551,6 @@ int WifiProvider::gets(char** buf, int size)
 	return received;
 }
 
-// Does the queue have a given char ?
-bool WifiProvider::has_char(char letter) {
-    int index = this->buffer.tail;
-    while( index != this->buffer.head ){
-        if( this->buffer.buffer[index] == letter ){
-            return true;
-        }
-        index = this->buffer.next_block_index(index);
-    }
-    return false;
-}
 
 void WifiProvider::on_gcode_received(void *argument)
 {
@@ -414,6 +586,9 @@ void WifiProvider::on_gcode_received(void *argument)
 					gcode->stream->printf("Data Received complete!\n");
 				}
 			} else if (gcode->subcode == 5) {
+				// transmit statistics, R resets them
+				print_tx_stats(gcode->stream);
+				if (gcode->has_letter('R')) memset(&tx_stats, 0, sizeof(tx_stats));
 			} else if (gcode->subcode == 6) {
 				char ip_addr[16] = "192.168.1.2";
 				char netmask[16] = "255.255.255.0";
@@ -758,6 +933,10 @@ void WifiProvider::init_wifi_module(bool reset) {
 		if (M8266WIFI_SPI_Delete_Connection( tcp_link_no, &status) == 0){
 			THEKERNEL->streams->printf("M8266WIFI_SPI_Delete_Connection ERROR, status:%d, high: %d, low: %d!\n", status, int(status >> 8), int(status & 0xff));
 		}
+		if (data_link != nullptr) {
+			data_link->reset();
+			M8266WIFI_SPI_Delete_Connection(data_link_no, &status);
+		}
 
 		// remove current stream
 		THEKERNEL->streams->remove_stream(this);
@@ -791,6 +970,16 @@ void WifiProvider::init_wifi_module(bool reset) {
 		THEKERNEL->streams->printf("M8266WIFI_SPI_Set_TcpServer_Auto_Discon_Timeout ERROR, status:%d, high: %d, low: %d!\n", status, int(status >> 8), int(status & 0xff));
 	}
 
+	// setup the file transfer TCP server
+	if (data_link != nullptr) {
+		snprintf(address, sizeof(address), "192.168.4.10");
+		if (M8266WIFI_SPI_Setup_Connection(2, this->data_port, address, 0, data_link_no, 3, &status) == 0) {
+			THEKERNEL->streams->printf("M8266WIFI_SPI_Setup_Connection ERROR, status:%d, high: %d, low: %d!\n", status, int(status >> 8), int(status & 0xff));
+		} else {
+			M8266WIFI_SPI_Set_TcpServer_Auto_Discon_Timeout(data_link_no, tcp_timeout_s, &status);
+		}
+	}
+
 	// load current AP IP and Netmask
 	if( M8266WIFI_SPI_Query_AP_Param(AP_PARAM_TYPE_IP_ADDR, (u8 *)this->ap_address, &param_len, &status) == 0)
 	{
@@ -17,11 +17,17 @@ using namespace std;
 #include "StreamOutput.h"
 
 #include "M8266WIFIDrv.h"
-#include "libs/RingBuffer.h"
+#include "libs/LineBuffer.h"
+
+class DataLink;
 
 #define WIFI_DATA_MAX_SIZE 1460
 #define WIFI_DATA_TIMEOUT_MS 10
 #define MAX_WLAN_SIGNALS 8
+#define TELEMETRY_LEASE_S 10
+#define WIFI_TX_IDLE_LOOPS 5      // send attempts from on_idle, the rest waits for the next pass
+#define WIFI_TX_FULL_LOOPS 100     // send attempts when the staging buffer is full before output is dropped
+#define WIFI_TX_FLUSH_LOOPS 5000   // send attempts when everything has to go out, as the old blocking send did
 
 class WifiProvider : public Module, public StreamOutput
 {
@@ -41,8 +47,9 @@ public:
     int _putc(int c);
     int _getc(void);
     bool ready();
-    bool has_char(char letter);
     int type(); // 0: serial, 1: wifi
+    int rx_free() { return this->buffer.free(); }
+    void flush();
 
 
 private:
@@ -61,20 +68,54 @@ private:
 
     void on_pin_rise();
     void receive_wifi_data();
+    void handle_udp_command(u16 len, u8 remote_ip[4], u16 remote_port);
+    void send_telemetry();
+    void service_data_link();
+
+    size_t stage_tx(const char *s, size_t n);
+    size_t send_tx(u32 max_loops);
+    size_t send_direct(const char *s, size_t n);
+    void print_tx_stats(StreamOutput *stream);
 
     mbed::InterruptIn *wifi_interrupt_pin; // Interrupt pin for measuring speed
     float probe_slow_rate;
 
-    RingBuffer<char, 256> buffer; // Receive buffer
+    LineBuffer buffer; // Receive buffer, wifi.rx_buffer_size chars
     string test_buffer;
 
 	u8 WifiData[WIFI_DATA_MAX_SIZE];
 
+	// transmit staging buffer, pending data is tx_buf[tx_start..tx_end)
+	// it goes out from on_idle on a newline, when a full packet is pending or when tx_flush_us has passed
+	char *tx_buf;
+	size_t tx_size;
+	size_t tx_start;
+	size_t tx_end;
+	uint32_t tx_flush_us;
+	uint32_t tx_staged_us;
+	struct {
+		uint32_t bytes;
+		uint32_t packets;
+		uint32_t stalls;
+		uint32_t dropped;
+		uint32_t max_fill;
+	} tx_stats;
+
 	int tcp_port;
+	int data_port;
+	DataLink *data_link; // file transfers on data_link_no, nullptr unless wifi.data_port is set
 	int udp_send_port;
 	int udp_recv_port;
 	int tcp_timeout_s;
 	int connection_fail_count;
+
+	// udp telemetry subscriber, the subscription lapses unless renewed within TELEMETRY_LEASE_S
+	char telemetry_address[16];
+	u16 telemetry_port;
+	int telemetry_max_hz;
+	uint32_t telemetry_period_us;
+	uint32_t telemetry_last_us;
+	uint8_t telemetry_lease_s;
 	string machine_name;
 	char ap_address[16];
 	char ap_netmask[16];
@@ -84,11 +125,13 @@ private:
     struct {
     	u8  tcp_link_no;
     	u8  udp_link_no;
+    	u8  data_link_no;
     	bool wifi_init_ok:1;
     	volatile bool halt_flag:1;
     	volatile bool query_flag:1;
     	volatile bool diagnose_flag:1;
     	volatile bool has_data_flag:1;
+    	bool tx_line_pending:1;
     };
 
 };
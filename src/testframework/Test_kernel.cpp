@@ -77,6 +77,15 @@ void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod){
     this->hooks[id_event].push_back(mod);
 }
 
+// tests only need to know the module wants gcodes
+void Kernel::register_for_gcode(char letter, uint16_t code, Module *mod){
+    if(!kernel_has_event(ON_GCODE_RECEIVED, mod)) this->hooks[ON_GCODE_RECEIVED].push_back(mod);
+}
+
+void Kernel::register_for_public_data(_EVENT_ENUM id_event, uint16_t csa, uint16_t csb, Module *mod){
+    if(!kernel_has_event(id_event, mod)) this->hooks[id_event].push_back(mod);
+}
+
 static std::map<_EVENT_ENUM, std::function<void(void*)> > event_callbacks;
 
 // Call a specific event with an argument
@@ -0,0 +1,11 @@
+// runs the unit tests that only need src/libs on the build machine instead of the board
+// see the Readme in the directory above for how to build it
+
+#include "easyunit/testharness.h"
+#include "easyunit/test.h"
+
+int main()
+{
+    const TestResult *res = TestRegistry::runAndPrint();
+    return res->getTotalFailures() == 0 && res->getTotalErrors() == 0 ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+#include "DiskBench.h"
+#include "disk.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "easyunit/test.h"
+
+// on the board the files go on the sd card, on the host in the current directory
+#ifdef __arm__
+#define BENCH_DIR "/sd/"
+#else
+#define BENCH_DIR ""
+#endif
+
+static const char *image_fn = BENCH_DIR "diskbench.img";
+static const char *file_fn = BENCH_DIR "diskbench.tmp";
+
+// disk backed by an image file, each sector is filled with its own number
+class ImageDisk : public MSD_Disk {
+public:
+    ImageDisk(uint32_t sectors) : sectors(sectors), reads(0)
+    {
+        char buf[512];
+        fp = fopen(image_fn, "w+");
+        for (uint32_t i = 0; fp != NULL && i < sectors; ++i) {
+            memset(buf, i & 0xFF, sizeof(buf));
+            fwrite(buf, 1, sizeof(buf), fp);
+        }
+    }
+
+    ~ImageDisk()
+    {
+        if(fp != NULL) fclose(fp);
+        remove(image_fn);
+    }
+
+    int disk_read(char *data, uint32_t block, uint32_t count)
+    {
+        reads++;
+        if(fp == NULL || block + count > sectors) return 1;
+        if(fseek(fp, block * 512, SEEK_SET) != 0) return 1;
+        return fread(data, 512, count, fp) == count ? 0 : 1;
+    }
+
+    uint32_t disk_sectors() { return sectors; }
+    bool busy() { return false; }
+
+    FILE *fp;
+    uint32_t sectors;
+    int reads;
+};
+
+// every call is 10us after the last, so each op takes 10us
+static uint32_t fake_us;
+static uint32_t fake_now() { return fake_us += 10; }
+
+static int idle_calls;
+static void count_idle() { idle_calls++; }
+
+static char bench_buf[2048 + 100];
+
+TEST(DiskBenchTest,sequential_read_covers_the_bytes_asked_for)
+{
+    ImageDisk disk(64);
+    ASSERT_TRUE(disk.fp != NULL);
+    idle_calls = 0;
+    DiskBench bench(fake_now, count_idle, bench_buf, sizeof(bench_buf));
+
+    // the buffer is rounded down to 4 sectors
+    DiskBench::result_t r = bench.disk_sequential_read(&disk, 0, 16 * 512);
+    ASSERT_TRUE(r.ok);
+    ASSERT_EQUALS_V(4, (int)r.ops);
+    ASSERT_EQUALS_V(16 * 512, (int)r.bytes);
+    ASSERT_EQUALS_V(4, disk.reads);
+    ASSERT_EQUALS_V(4, idle_calls);
+
+    // the idle callback is not timed
+    ASSERT_EQUALS_V(40, (int)r.busy_us);
+    ASSERT_EQUALS_V(10, (int)r.p50_us);
+    ASSERT_EQUALS_V(10, (int)r.p99_us);
+    ASSERT_EQUALS_V(10, (int)r.max_us);
+    ASSERT_EQUALS_V(200000, (int)r.kb_per_s());  // 8 KB in 40us
+
+    // last sector was the one asked for
+    ASSERT_EQUALS_V(15, bench_buf[3 * 512]);
+}
+
+TEST(DiskBenchTest,sequential_read_fails_past_the_end)
+{
+    ImageDisk disk(8);
+    ASSERT_TRUE(disk.fp != NULL);
+    DiskBench bench(fake_now, nullptr, bench_buf, sizeof(bench_buf));
+
+    DiskBench::result_t r = bench.disk_sequential_read(&disk, 0, 16 * 512);
+    ASSERT_TRUE(!r.ok);
+    ASSERT_EQUALS_V(2, (int)r.ops);
+}
+
+TEST(DiskBenchTest,random_read_stays_on_the_disk)
+{
+    ImageDisk disk(32);
+    ASSERT_TRUE(disk.fp != NULL);
+    DiskBench bench(fake_now, nullptr, bench_buf, sizeof(bench_buf));
+
+    // more ops than latency samples, so the reservoir has to replace some
+    DiskBench::result_t r = bench.disk_random_read(&disk, disk.sectors, 1000);
+    ASSERT_TRUE(r.ok);
+    ASSERT_EQUALS_V(1000, (int)r.ops);
+    ASSERT_EQUALS_V(1000 * 512, (int)r.bytes);
+    ASSERT_EQUALS_V(10, (int)r.p99_us);
+}
+
+TEST(DiskBenchTest,file_write_then_reads)
+{
+    DiskBench bench(fake_now, nullptr, bench_buf, sizeof(bench_buf));
+
+    DiskBench::result_t r = bench.file_write(file_fn, 8 * 2048);
+    ASSERT_TRUE(r.ok);
+    ASSERT_EQUALS_V(8, (int)r.ops);
+    ASSERT_EQUALS_V(8 * 2048, (int)r.bytes);
+
+    r = bench.file_sequential_read(file_fn);
+    ASSERT_TRUE(r.ok);
+    ASSERT_EQUALS_V(8, (int)r.ops);
+    ASSERT_EQUALS_V(8 * 2048, (int)r.bytes);
+    ASSERT_EQUALS_V('A', bench_buf[0]);
+
+    r = bench.file_random_read(file_fn, 50);
+    ASSERT_TRUE(r.ok);
+    ASSERT_EQUALS_V(50, (int)r.ops);
+    ASSERT_EQUALS_V(50 * 512, (int)r.bytes);
+
+    remove(file_fn);
+}
+
+TEST(DiskBenchTest,file_reads_fail_without_the_file)
+{
+    DiskBench bench(fake_now, nullptr, bench_buf, sizeof(bench_buf));
+    remove(file_fn);
+
+    ASSERT_TRUE(!bench.file_sequential_read(file_fn).ok);
+    ASSERT_TRUE(!bench.file_random_read(file_fn, 10).ok);
+}
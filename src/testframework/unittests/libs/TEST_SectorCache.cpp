@@ -0,0 +1,127 @@
+#include "SectorCache.h"
+#include "disk.h"
+
+#include <map>
+#include <string>
+#include <string.h>
+
+#include "easyunit/test.h"
+
+// disk whose sectors are filled with their own number unless written, counts the transfers it is asked for
+class TestDisk : public MSD_Disk {
+public:
+    TestDisk() : reads(0), sectors_read(0) {}
+
+    int disk_read(char *data, uint32_t block, uint32_t count)
+    {
+        reads++;
+        sectors_read += count;
+        for (uint32_t i = 0; i < count; ++i) {
+            std::map<uint32_t, std::string>::iterator w = written.find(block + i);
+            if(w != written.end()) memcpy(data + i * 512, w->second.data(), 512);
+            else memset(data + i * 512, (block + i) & 0xFF, 512);
+        }
+        return 0;
+    }
+
+    int disk_write(const char *data, uint32_t block, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; ++i) written[block + i].assign(data + i * 512, 512);
+        return 0;
+    }
+
+    bool busy() { return false; }
+
+    int reads;
+    int sectors_read;
+    std::map<uint32_t, std::string> written;
+};
+
+static bool is_sector(const char *buf, uint8_t v)
+{
+    for (int i = 0; i < 512; ++i) {
+        if((uint8_t)buf[i] != v) return false;
+    }
+    return true;
+}
+
+TEST(SectorCacheTest,metadata_sectors_hit_after_first_read)
+{
+    TestDisk disk;
+    SectorCache cache(&disk);
+    ASSERT_TRUE(cache.init(2, 4));
+    cache.set_metadata_limit(10);
+    cache.set_sectors(100);
+
+    char buf[512];
+    ASSERT_TRUE(cache.read(buf, 3, 1) == 0 && is_sector(buf, 3));
+    ASSERT_TRUE(cache.read(buf, 4, 1) == 0 && is_sector(buf, 4));
+    ASSERT_TRUE(cache.read(buf, 3, 1) == 0 && is_sector(buf, 3));
+    ASSERT_TRUE(disk.reads == 2);
+
+    // 4 is now the least recently used and gets evicted
+    ASSERT_TRUE(cache.read(buf, 5, 1) == 0 && is_sector(buf, 5));
+    ASSERT_TRUE(cache.read(buf, 3, 1) == 0);
+    ASSERT_TRUE(disk.reads == 3);
+    ASSERT_TRUE(cache.read(buf, 4, 1) == 0 && is_sector(buf, 4));
+    ASSERT_TRUE(disk.reads == 4);
+}
+
+TEST(SectorCacheTest,sequential_reads_fetch_ahead)
+{
+    TestDisk disk;
+    SectorCache cache(&disk);
+    ASSERT_TRUE(cache.init(2, 4));
+    cache.set_metadata_limit(10);
+    cache.set_sectors(100);
+
+    char buf[512];
+    ASSERT_TRUE(cache.read(buf, 20, 1) == 0 && is_sector(buf, 20));
+    ASSERT_TRUE(disk.reads == 1);
+
+    // continuing reads are served from one four sector read
+    for (uint8_t s = 21; s < 25; ++s) {
+        ASSERT_TRUE(cache.read(buf, s, 1) == 0 && is_sector(buf, s));
+    }
+    ASSERT_TRUE(disk.reads == 2);
+    ASSERT_TRUE(disk.sectors_read == 5);
+    ASSERT_TRUE(cache.read(buf, 25, 1) == 0 && is_sector(buf, 25));
+    ASSERT_TRUE(disk.reads == 3);
+
+    // a random read goes straight to the disk
+    ASSERT_TRUE(cache.read(buf, 60, 1) == 0 && is_sector(buf, 60));
+    ASSERT_TRUE(disk.sectors_read == 10);
+
+    // never past the end of the disk
+    ASSERT_TRUE(cache.read(buf, 98, 1) == 0);
+    ASSERT_TRUE(cache.read(buf, 99, 1) == 0 && is_sector(buf, 99));
+    ASSERT_TRUE(disk.sectors_read == 12);
+}
+
+TEST(SectorCacheTest,writes_update_cached_copies)
+{
+    TestDisk disk;
+    SectorCache cache(&disk);
+    ASSERT_TRUE(cache.init(2, 4));
+    cache.set_metadata_limit(10);
+    cache.set_sectors(100);
+
+    char buf[1024];
+    cache.read(buf, 2, 1);
+    cache.read(buf, 30, 1);
+    cache.read(buf, 31, 1);
+
+    memset(buf, 0xAA, sizeof(buf));
+    ASSERT_TRUE(cache.write(buf, 2, 1) == 0);
+    ASSERT_TRUE(cache.write(buf, 32, 2) == 0);
+
+    int reads = disk.reads;
+    ASSERT_TRUE(cache.read(buf, 2, 1) == 0 && is_sector(buf, 0xAA));
+    ASSERT_TRUE(cache.read(buf, 32, 2) == 0 && is_sector(buf, 0xAA) && is_sector(buf + 512, 0xAA));
+    ASSERT_TRUE(disk.reads == reads);
+
+    // after invalidating the card is read again
+    cache.invalidate();
+    ASSERT_TRUE(cache.read(buf, 2, 1) == 0 && is_sector(buf, 0xAA));
+    ASSERT_TRUE(disk.reads == reads + 1);
+}